@@ -0,0 +1,195 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "db.h"
+#include "digest.h"
+#include "util.h"
+
+/*
+db format (each line):
+
+	hUID\000LVL\000DIGEST\000\n
+	^
+	| 'h' = "unlock" event (user started a new level), DIGEST is the
+	|       secret key's keyed digest, as hex (see digest.h)
+
+	uUID\000LVL\000SECRET_KEY\000\n
+	^
+	| 'u' = old-style "unlock" event, with the secret key in the clear.
+	|       Still read, but no longer written.
+
+	cUID\000LVL\000\n
+	^
+	| 'c' = "completed" event (level passed)
+
+	aUID\000LVL\000\n
+	^
+	| 'a' = "attempt" event (wrong key claimed for the level). These
+	|       go in the separate attempts log, not the db.
+
+Every record can also have a TS\000 field right before its newline,
+with the time it was written in ms since the epoch. Records from before
+there were timestamps don't.
+*/
+
+// Returns the NUL-terminated field at *cur and advances *cur past it,
+// or returns NULL if the field isn't complete before end.
+static char *nextfield(char **cur, char *end) {
+	char *field = *cur;
+	char *nul = memchr(field, '\0', end - field);
+	if (!nul)
+		return NULL;
+	*cur = nul + 1;
+	return field;
+}
+
+static unsigned long parsenum(char *str, char *what) {
+	char *nendptr;
+	errno = 0;
+	unsigned long n = strtoul(str, &nendptr, 10);
+	if (errno || *str == '\0' || *nendptr != '\0') {
+		fprintf(stdout, "invalid %s: '%s'\n", what, str);
+		exit(1);
+	}
+	return n;
+}
+
+size_t parsedb(char *buf, size_t len, void (*fn)(struct dbent *, void *), void *arg) {
+	char *end = buf + len;
+	char *cur = buf;
+	// end of the last complete record
+	size_t done = 0;
+
+	while (cur < end) {
+		char *rec = cur;
+		char evt = *cur++;
+		struct dbent ent;
+		char *uidstr, *lvlstr, *keystr;
+		if (!(uidstr = nextfield(&cur, end)) || !(lvlstr = nextfield(&cur, end)))
+			break;
+		if (evt == 'u') { // 'unlock' event
+			if (!(keystr = nextfield(&cur, end)))
+				break;
+			ent.kind = 'u';
+			ent.ku.uid = parsenum(uidstr, "uid");
+			ent.ku.lvl = parsenum(lvlstr, "lvl");
+			ent.ku.secret = keystr;
+			ent.ku.digest = NULL;
+		} else if (evt == 'h') { // 'unlock' event, with a digest
+			if (!(keystr = nextfield(&cur, end)))
+				break;
+			if (strlen(keystr) != DIGEST_HEXLEN
+					|| strspn(keystr, "0123456789abcdef") != DIGEST_HEXLEN) {
+				fprintf(stderr, "invalid digest at offset %zu\n", rec - buf);
+				exit(1);
+			}
+			ent.kind = 'u';
+			ent.ku.uid = parsenum(uidstr, "uid");
+			ent.ku.lvl = parsenum(lvlstr, "lvl");
+			ent.ku.secret = NULL;
+			ent.ku.digest = keystr;
+		} else if (evt == 'c' || evt == 'a') { // 'completed'/'attempt' event
+			ent.kind = evt;
+			ent.kc.uid = parsenum(uidstr, "uid");
+			ent.kc.lvl = parsenum(lvlstr, "lvl");
+		} else {
+			fprintf(stderr, "Unknown db event '%c'\n", evt);
+			exit(1);
+		}
+		ent.ts = 0;
+		if (cur < end && *cur != '\n') {
+			char *tsstr = nextfield(&cur, end);
+			if (!tsstr)
+				break;
+			ent.ts = parsenum(tsstr, "timestamp");
+		}
+		// the record isn't finished until its newline is written
+		if (cur == end)
+			break;
+		if (*cur != '\n') {
+			fprintf(stderr, "Missing newline after db record at offset %zu\n", rec - buf);
+			exit(1);
+		}
+		cur++;
+		done = cur - buf;
+		(*fn)(&ent, arg);
+	}
+
+	return done;
+}
+
+void fmtdbent(FILE *out, struct dbent *ent) {
+	if (ent->kind == 'u') {
+		fprintf(out, "%c%lu", ent->ku.digest ? 'h' : 'u', (unsigned long)ent->ku.uid);
+		fputc('\0', out);
+
+		fprintf(out, "%u", ent->ku.lvl);
+		fputc('\0', out);
+
+		fputs(ent->ku.digest ? ent->ku.digest : ent->ku.secret, out);
+		fputc('\0', out);
+	} else if (ent->kind == 'c' || ent->kind == 'a') {
+		fprintf(out, "%c%lu", ent->kind, (unsigned long)ent->kc.uid);
+		fputc('\0', out);
+
+		fprintf(out, "%u", ent->kc.lvl);
+		fputc('\0', out);
+	} else {
+		fprintf(stderr, "Unknown kind '%c' for inserted ent\n", ent->kind);
+		exit(1);
+	}
+
+	if (ent->ts) {
+		fprintf(out, "%llu", ent->ts);
+		fputc('\0', out);
+	}
+	fputc('\n', out);
+}
+
+static void _lastts_iter(struct dbent *ent, void *uarg) {
+	*(unsigned long long *)uarg = ent->ts;
+}
+unsigned long long lastdbts(char *buf, size_t len) {
+	if (len == 0)
+		return 0;
+	// Only a record's last byte can be a newline, so the last record
+	// starts right after the one before the end.
+	size_t start = len - 1;
+	while (start > 0 && buf[start - 1] != '\n')
+		start--;
+	unsigned long long ts = 0;
+	parsedb(buf + start, len - start, _lastts_iter, &ts);
+	return ts;
+}
+
+char *mapdb(char *path, size_t *len) {
+	*len = 0;
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		if (errno == ENOENT)
+			return NULL;
+		perror(path);
+		exit(1);
+	}
+	struct stat st;
+	MUST(fstat(fd, &st));
+	*len = st.st_size;
+	char *content = NULL;
+	if (*len != 0)
+		content = MUST(mmap(NULL, *len, PROT_READ, MAP_PRIVATE, fd, 0));
+	close(fd);
+	// it's read front to back, once
+	if (content)
+		madvise(content, *len, MADV_SEQUENTIAL);
+	return content;
+}
+
+void unmapdb(char *content, size_t len) {
+	if (content)
+		munmap(content, len);
+}
@@ -0,0 +1,54 @@
+#ifndef __HAVE_DB_H
+#define __HAVE_DB_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+struct dbent {
+	char kind;
+	// When the record was written, in ms since the epoch. Never less than
+	// the previous record's, even if the clock went backwards. 0 for
+	// records from before there were timestamps.
+	unsigned long long ts;
+
+	union {
+		// kind 'u':
+		struct {
+			uid_t uid;
+			unsigned lvl;
+			// Exactly one of these is set: new records only store the
+			// keyed digest of the secret (DIGEST_HEXLEN hex digits), old
+			// ones have the secret itself.
+			char *secret;
+			char *digest;
+		} ku;
+
+		// kind 'c', and 'a' (a wrong claim, only in the attempts log):
+		struct {
+			uid_t uid;
+			unsigned lvl;
+		} kc;
+	};
+};
+
+// Calls fn for each complete record in buf[0..len) and returns the number
+// of bytes consumed. Anything after that is a record that hasn't been
+// completely written yet. Exits on a malformed record. Both kinds of
+// unlock record ('u' and 'h') are passed to fn as kind 'u'.
+size_t parsedb(char *buf, size_t len, void (*fn)(struct dbent *, void *), void *arg);
+
+// writes ent to out in the db format
+void fmtdbent(FILE *out, struct dbent *ent);
+
+// timestamp of the last complete record in buf[0..len), or 0 if it has none
+unsigned long long lastdbts(char *buf, size_t len);
+
+// Maps the db file at path read-only, for reading it without the lock.
+// The size is a snapshot: anything appended after this isn't mapped.
+// Returns NULL, with *len 0, for an empty or missing file. Undo with
+// unmapdb().
+char *mapdb(char *path, size_t *len);
+void unmapdb(char *content, size_t len);
+
+#endif
@@ -0,0 +1,153 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "digest.h"
+#include "util.h"
+
+#define ROTL(X, B) (((X) << (B)) | ((X) >> (64 - (B))))
+
+#define SIPROUND \
+	do { \
+		v0 += v1; v1 = ROTL(v1, 13); v1 ^= v0; v0 = ROTL(v0, 32); \
+		v2 += v3; v3 = ROTL(v3, 16); v3 ^= v2; \
+		v0 += v3; v3 = ROTL(v3, 21); v3 ^= v0; \
+		v2 += v1; v1 = ROTL(v1, 17); v1 ^= v2; v2 = ROTL(v2, 32); \
+	} while (0)
+
+static uint64_t load64(const unsigned char *p) {
+	uint64_t x = 0;
+	for (int i = 7; i >= 0; i--)
+		x = x << 8 | p[i];
+	return x;
+}
+
+static void store64(unsigned char *p, uint64_t x) {
+	for (int i = 0; i < 8; i++)
+		p[i] = x >> (8 * i);
+}
+
+void siphash128(const unsigned char key[DIGEST_KEYLEN], const void *msg, size_t len,
+		unsigned char out[DIGEST_LEN]) {
+	const unsigned char *in = msg;
+	uint64_t k0 = load64(key);
+	uint64_t k1 = load64(key + 8);
+	uint64_t v0 = k0 ^ 0x736f6d6570736575ull;
+	uint64_t v1 = k1 ^ 0x646f72616e646f6dull ^ 0xee;
+	uint64_t v2 = k0 ^ 0x6c7967656e657261ull;
+	uint64_t v3 = k1 ^ 0x7465646279746573ull;
+
+	const unsigned char *end = in + (len & ~(size_t)7);
+	for (; in != end; in += 8) {
+		uint64_t m = load64(in);
+		v3 ^= m;
+		SIPROUND;
+		SIPROUND;
+		v0 ^= m;
+	}
+
+	uint64_t b = (uint64_t)len << 56;
+	for (int i = (len & 7) - 1; i >= 0; i--)
+		b |= (uint64_t)in[i] << (8 * i);
+	v3 ^= b;
+	SIPROUND;
+	SIPROUND;
+	v0 ^= b;
+
+	v2 ^= 0xee;
+	SIPROUND;
+	SIPROUND;
+	SIPROUND;
+	SIPROUND;
+	store64(out, v0 ^ v1 ^ v2 ^ v3);
+	v1 ^= 0xdd;
+	SIPROUND;
+	SIPROUND;
+	SIPROUND;
+	SIPROUND;
+	store64(out + 8, v0 ^ v1 ^ v2 ^ v3);
+}
+
+static int readkey(char *path, unsigned char key[DIGEST_KEYLEN]) {
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		if (errno == ENOENT)
+			return 0;
+		perror(path);
+		exit(1);
+	}
+	struct stat st;
+	MUST(fstat(fd, &st));
+	if (st.st_size != DIGEST_KEYLEN || MUST(read(fd, key, DIGEST_KEYLEN)) != DIGEST_KEYLEN) {
+		fprintf(stderr, "%s should be exactly %d bytes\n", path, DIGEST_KEYLEN);
+		exit(1);
+	}
+	close(fd);
+	return 1;
+}
+
+int loaddigestkey(char *path, unsigned char key[DIGEST_KEYLEN], int create) {
+	if (readkey(path, key))
+		return 1;
+	if (!create)
+		return 0;
+
+	// Write the new key to a temporary file and link() it into place, so
+	// that nobody ever reads a half-written key, and if someone else beat
+	// us to it we use theirs.
+	char tmppath[256];
+	int nwritten = snprintf(tmppath, sizeof(tmppath), "%s.%ld", path, (long)getpid());
+	if (nwritten >= sizeof(tmppath)) {
+		fputs("tmppath overflow :(\n", stderr);
+		exit(1);
+	}
+	if (getrandom(key, DIGEST_KEYLEN, 0) != DIGEST_KEYLEN) {
+		perror("getrandom");
+		exit(1);
+	}
+	int fd = MUST(open(tmppath, O_CREAT|O_TRUNC|O_WRONLY, 0600));
+	if (MUST(write(fd, key, DIGEST_KEYLEN)) != DIGEST_KEYLEN) {
+		fputs("short write to digest key\n", stderr);
+		exit(1);
+	}
+	MUST(fsync(fd));
+	close(fd);
+	int linked = link(tmppath, path);
+	int linkerr = errno;
+	MUST(unlink(tmppath));
+	if (linked == -1 && linkerr != EEXIST) {
+		errno = linkerr;
+		perror(path);
+		exit(1);
+	}
+	if (linked == -1 && !readkey(path, key)) {
+		fprintf(stderr, "%s disappeared\n", path);
+		exit(1);
+	}
+	return 1;
+}
+
+void digestsecret(const unsigned char key[DIGEST_KEYLEN], char *secret,
+		char hex[DIGEST_HEXLEN + 1]) {
+	static const char hexdigits[] = "0123456789abcdef";
+	unsigned char digest[DIGEST_LEN];
+	siphash128(key, secret, strlen(secret), digest);
+	for (int i = 0; i < DIGEST_LEN; i++) {
+		hex[2*i] = hexdigits[digest[i] >> 4];
+		hex[2*i + 1] = hexdigits[digest[i] & 0xf];
+	}
+	hex[DIGEST_HEXLEN] = '\0';
+}
+
+int digesteq(const char *a, const char *b) {
+	// volatile so the compiler can't turn this back into an early exit
+	volatile unsigned char diff = 0;
+	for (int i = 0; i < DIGEST_HEXLEN; i++)
+		diff |= a[i] ^ b[i];
+	return diff == 0;
+}
@@ -0,0 +1,28 @@
+#ifndef __HAVE_DIGEST_H
+#define __HAVE_DIGEST_H
+
+#include <stddef.h>
+
+#define DIGEST_KEYLEN 16
+#define DIGEST_LEN 16
+// digests are stored in the db as lowercase hex
+#define DIGEST_HEXLEN (DIGEST_LEN * 2)
+
+// SipHash-2-4 with the 128-bit output
+void siphash128(const unsigned char key[DIGEST_KEYLEN], const void *msg, size_t len,
+		unsigned char out[DIGEST_LEN]);
+
+// Reads the instance's digest key from path. If it doesn't exist yet and
+// create is set, creates it (mode 0600) with a fresh random key; if create
+// isn't set, returns 0. Exits if the file is bad.
+int loaddigestkey(char *path, unsigned char key[DIGEST_KEYLEN], int create);
+
+// writes the keyed digest of secret to hex, as DIGEST_HEXLEN hex digits
+void digestsecret(const unsigned char key[DIGEST_KEYLEN], char *secret,
+		char hex[DIGEST_HEXLEN + 1]);
+
+// Compares two hex digests in time that doesn't depend on where they
+// differ. Both must be DIGEST_HEXLEN long.
+int digesteq(const char *a, const char *b);
+
+#endif
@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "db.h"
+#include "export.h"
+#include "names.h"
+#include "util.h"
+
+#define OUTBUFSIZE (1 << 20)
+
+// We do our own output buffering; going through stdio for every field
+// costs more than the parsing does.
+static char *g_outbuf;
+static size_t g_outlen;
+
+static void flushout(void) {
+	char *cur = g_outbuf;
+	while (g_outlen > 0) {
+		ssize_t nwritten = MUST(write(1, cur, g_outlen));
+		cur += nwritten;
+		g_outlen -= nwritten;
+	}
+}
+
+static void outmem(char *s, size_t len) {
+	// no single field comes anywhere near OUTBUFSIZE
+	if (g_outlen + len > OUTBUFSIZE)
+		flushout();
+	memcpy(g_outbuf + g_outlen, s, len);
+	g_outlen += len;
+}
+
+static void outstr(char *s) {
+	outmem(s, strlen(s));
+}
+
+static void outchr(char c) {
+	outmem(&c, 1);
+}
+
+static void outnum(unsigned long n) {
+	char buf[24];
+	char *p = buf + sizeof(buf);
+	do {
+		*--p = '0' + n % 10;
+		n /= 10;
+	} while (n);
+	outmem(p, buf + sizeof(buf) - p);
+}
+
+// secrets are alphanumeric, but usernames come from NSS and could be anything
+static void outcsvstr(char *s) {
+	if (!strpbrk(s, ",\"\r\n")) {
+		outstr(s);
+		return;
+	}
+	outchr('"');
+	for (; *s; s++) {
+		if (*s == '"')
+			outchr('"');
+		outchr(*s);
+	}
+	outchr('"');
+}
+
+static void outjsonstr(char *s) {
+	outchr('"');
+	for (; *s; s++) {
+		unsigned char c = *s;
+		if (c == '"' || c == '\\') {
+			outchr('\\');
+			outchr(c);
+		} else if (c < 0x20) {
+			char esc[8];
+			snprintf(esc, sizeof(esc), "\\u%04x", c);
+			outstr(esc);
+		} else {
+			outchr(c);
+		}
+	}
+	outchr('"');
+}
+
+struct _export_iter_arg {
+	enum exportfmt fmt;
+	struct exportfilter *filter;
+};
+static void _export_iter(struct dbent *ent, void *uarg) {
+	struct _export_iter_arg *arg = uarg;
+	struct exportfilter *f = arg->filter;
+	uid_t uid = ent->kind == 'u' ? ent->ku.uid : ent->kc.uid;
+	unsigned lvl = ent->kind == 'u' ? ent->ku.lvl : ent->kc.lvl;
+	if (uid < f->uidmin || uid > f->uidmax || lvl < f->lvlmin || lvl > f->lvlmax)
+		return;
+	if (!strchr(f->kinds, ent->kind))
+		return;
+	// an unlock has one or the other, depending on how old it is
+	char *secret = ent->kind == 'u' && ent->ku.secret ? ent->ku.secret : "";
+	char *digest = ent->kind == 'u' && ent->ku.digest ? ent->ku.digest : "";
+
+	if (arg->fmt == EXPORT_CSV) {
+		outchr(ent->kind);
+		outchr(',');
+		outnum(uid);
+		outchr(',');
+		outcsvstr(usrnameof(uid));
+		outchr(',');
+		outnum(lvl);
+		outchr(',');
+		outcsvstr(secret);
+		outchr(',');
+		outstr(digest);
+		outchr(',');
+		if (ent->ts)
+			outnum(ent->ts);
+		outchr('\n');
+	} else {
+		outstr("{\"kind\":\"");
+		outchr(ent->kind);
+		outstr("\",\"uid\":");
+		outnum(uid);
+		outstr(",\"user\":");
+		outjsonstr(usrnameof(uid));
+		outstr(",\"lvl\":");
+		outnum(lvl);
+		if (*secret) {
+			outstr(",\"secret\":");
+			outjsonstr(secret);
+		}
+		if (*digest) {
+			outstr(",\"digest\":\"");
+			outstr(digest);
+			outchr('"');
+		}
+		if (ent->ts) {
+			outstr(",\"ts\":");
+			outnum(ent->ts);
+		}
+		outstr("}\n");
+	}
+}
+
+void exportdb(char *path, enum exportfmt fmt, struct exportfilter *filter) {
+	// anything appended after this isn't exported
+	size_t len;
+	char *content = mapdb(path, &len);
+
+	g_outbuf = MUST(malloc(OUTBUFSIZE));
+	g_outlen = 0;
+	if (fmt == EXPORT_CSV)
+		outstr("kind,uid,user,lvl,secret,digest,ts\n");
+
+	struct _export_iter_arg arg = {
+		.fmt = fmt,
+		.filter = filter,
+	};
+	parsedb(content, len, _export_iter, &arg);
+	flushout();
+
+	free(g_outbuf);
+	unmapdb(content, len);
+}
@@ -0,0 +1,24 @@
+#ifndef __HAVE_EXPORT_H
+#define __HAVE_EXPORT_H
+
+#include <sys/types.h>
+
+enum exportfmt {
+	EXPORT_CSV,
+	EXPORT_JSONL,
+};
+
+// only records matching all of these are exported; ranges are inclusive
+struct exportfilter {
+	uid_t uidmin, uidmax;
+	unsigned lvlmin, lvlmax;
+	// record kinds to include, e.g. "uc"
+	char *kinds;
+};
+
+// Streams the records of the db file at path to stdout. The db is only
+// ever appended to, so this reads it without taking the lock, and stops
+// at a record that is still being written.
+void exportdb(char *path, enum exportfmt fmt, struct exportfilter *filter);
+
+#endif
@@ -0,0 +1,97 @@
+#include <grp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "instance.h"
+#include "util.h"
+
+/*
+config format (each line):
+
+	NAME GROUP DIR
+
+NAME identifies the instance (for admins, see KEYHUNT_INSTANCE in main.c).
+GROUP is a group name, a numeric gid (which avoids an NSS lookup), or '*'
+to match everyone. DIR is the absolute path of the instance directory.
+Blank lines and lines starting with '#' are ignored. For example:
+
+	# one db, one lock and one play/ tree per section
+	sec1   cs101-01   /home/ta/keyhunt/sec1
+	sec2   cs101-02   /home/ta/keyhunt/sec2
+	staff  *          /home/ta/keyhunt/staff
+*/
+
+static int ingroup(char *group) {
+	if (!strcmp(group, "*"))
+		return 1;
+
+	char *nendptr;
+	gid_t gid = strtoul(group, &nendptr, 10);
+	if (*group == '\0' || *nendptr != '\0') {
+		struct group *grp = getgrnam(group);
+		if (!grp)
+			return 0;
+		gid = grp->gr_gid;
+	}
+
+	if (gid == getgid())
+		return 1;
+	// the kernel's list, so this doesn't need NSS
+	int ngroups = MUST(getgroups(0, NULL));
+	gid_t *groups = MUST(malloc((ngroups + 1) * sizeof(*groups)));
+	ngroups = MUST(getgroups(ngroups, groups));
+	int found = 0;
+	for (int i = 0; i < ngroups; i++) {
+		if (groups[i] == gid)
+			found = 1;
+	}
+	free(groups);
+	return found;
+}
+
+char *findinstance(char *confpath, char *name, char *fallback) {
+	FILE *f = fopen(confpath, "r");
+	if (!f && errno == ENOENT)
+		return fallback;
+	// Anything else (e.g. a config we can't read) would quietly put every
+	// section in the fallback instance, so it's fatal.
+	if (!f) {
+		perror(confpath);
+		exit(1);
+	}
+
+	// we run setuid, so the config decides where we write as the owner
+	struct stat st;
+	MUST(fstat(fileno(f), &st));
+	if (st.st_uid != 0 || (st.st_mode & (S_IWGRP|S_IWOTH))) {
+		fprintf(stderr, "%s must be owned by root and writable only by root\n", confpath);
+		exit(1);
+	}
+
+	char *found = NULL;
+	char *line = NULL;
+	size_t linecap = 0;
+	unsigned lineno = 0;
+	while (!found && getline(&line, &linecap, f) != -1) {
+		lineno++;
+		char *ws = " \t\n";
+		char *instname = strtok(line, ws);
+		if (!instname || *instname == '#')
+			continue;
+		char *group = strtok(NULL, ws);
+		char *dir = strtok(NULL, ws);
+		if (!group || !dir || strtok(NULL, ws) || *dir != '/') {
+			fprintf(stderr, "%s:%u: expected NAME GROUP /ABSOLUTE/DIR\n", confpath, lineno);
+			exit(1);
+		}
+
+		if (name ? !strcmp(name, instname) : ingroup(group))
+			found = MUST(strdup(dir));
+	}
+	free(line);
+	fclose(f);
+	return found;
+}
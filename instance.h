@@ -0,0 +1,15 @@
+#ifndef __HAVE_INSTANCE_H
+#define __HAVE_INSTANCE_H
+
+// Picks the instance directory (which holds the db and the play/ tree)
+// from the config file at confpath.
+//
+// If name is non-NULL, the instance with that name is chosen. Otherwise
+// it's the first instance whose group the calling user is in.
+//
+// Returns the instance's path, or NULL if no instance matched. If the
+// config file doesn't exist, every user gets fallback. Exits if the
+// config file can't be read, or could be tampered with by anyone but root.
+char *findinstance(char *confpath, char *name, char *fallback);
+
+#endif
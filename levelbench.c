@@ -0,0 +1,596 @@
+// levelbench: generates every level many times into a scratch directory
+// with a fixed seed, reports what each generation costs, and checks that
+// every generated instance has exactly one answer, which is the secret,
+// and that the reference solvers in solve.c find it.
+//
+// Every level is then generated again from the same seed, in a child
+// process that is traced with ptrace to count its syscalls (so that the
+// tracing doesn't slow down the timed runs), and each instance has to
+// come out the same as the first time.
+//
+//     make levelbench
+//     ./levelbench [-n RUNS] [-s SEED] [LEVEL...]
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/ptrace.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "digest.h"
+#include "levels.h"
+#include "solve.h"
+#include "util.h"
+
+struct instance {
+	int dirfd;
+	int filesdir;
+	// the README, NUL-terminated
+	char *readme;
+};
+
+// Returns how many answers the instance has, and one of them in *answer
+// (malloc'd).
+typedef unsigned (*checker_t)(struct instance *inst, char **answer);
+
+static char *readfileat(int dirfd, char *name, size_t *len) {
+	int fd = MUST(openat(dirfd, name, O_RDONLY));
+	struct stat st;
+	MUST(fstat(fd, &st));
+	char *buf = MUST(malloc(st.st_size + 1));
+	size_t got = 0;
+	while (got < st.st_size) {
+		ssize_t n = MUST(read(fd, buf + got, st.st_size - got));
+		if (n == 0)
+			break;
+		got += n;
+	}
+	buf[got] = '\0';
+	close(fd);
+	if (len)
+		*len = got;
+	return buf;
+}
+
+struct line {
+	char *s;
+	size_t len;
+};
+
+// splits files/lines into lines (without their '\n'), in place
+static struct line *readlines(struct instance *inst, size_t *nlines, char **buf) {
+	size_t len;
+	*buf = readfileat(inst->filesdir, "lines", &len);
+	size_t cap = 1024;
+	struct line *lines = MUST(malloc(cap * sizeof(*lines)));
+	*nlines = 0;
+	char *cur = *buf, *end = *buf + len;
+	while (cur < end) {
+		char *nl = memchr(cur, '\n', end - cur);
+		if (!nl)
+			nl = end;
+		if (*nlines == cap) {
+			cap *= 2;
+			lines = MUST(realloc(lines, cap * sizeof(*lines)));
+		}
+		*nl = '\0';
+		lines[(*nlines)++] = (struct line) { cur, nl - cur };
+		cur = nl + 1;
+	}
+	return lines;
+}
+
+// Counts the lines of files/lines that pred() accepts.
+static unsigned countlines(struct instance *inst, int (*pred)(struct line *, void *),
+		void *arg, char **answer) {
+	char *buf;
+	size_t nlines;
+	struct line *lines = readlines(inst, &nlines, &buf);
+	unsigned n = 0;
+	for (size_t i = 0; i < nlines; i++) {
+		if ((*pred)(&lines[i], arg)) {
+			n++;
+			free(*answer);
+			*answer = MUST(strdup(lines[i].s));
+		}
+	}
+	free(lines);
+	free(buf);
+	return n;
+}
+
+// a DIR for dirfd that starts from the beginning, wherever dirfd is
+static DIR *opendirat(int dirfd) {
+	// (the dup shares dirfd's position)
+	DIR *dir = MUST(fdopendir(MUST(dup(dirfd))));
+	rewinddir(dir);
+	return dir;
+}
+
+// The key has to be the one line of files/secret, which has to be the
+// only file there.
+static unsigned check_onboarding(struct instance *inst, char **answer) {
+	DIR *dir = opendirat(inst->filesdir);
+	struct dirent *ent;
+	unsigned nfiles = 0;
+	while ((ent = readdir(dir)) != NULL) {
+		if (strcmp(ent->d_name, ".") && strcmp(ent->d_name, ".."))
+			nfiles++;
+	}
+	closedir(dir);
+	if (nfiles != 1 || faccessat(inst->filesdir, "secret", F_OK, 0) == -1)
+		return 0;
+
+	size_t len;
+	char *buf = readfileat(inst->filesdir, "secret", &len);
+	size_t keylen = strspn(buf, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789");
+	unsigned ok = keylen > 0 && keylen + 1 == len && buf[keylen] == '\n';
+	buf[keylen] = '\0';
+	*answer = buf;
+	return ok;
+}
+
+static int _alldigits(struct line *l, void *unused) {
+	return l->len > 0 && strspn(l->s, "0123456789") == l->len;
+}
+static unsigned check_digitline(struct instance *inst, char **answer) {
+	return countlines(inst, _alldigits, NULL, answer);
+}
+
+static int _haslen(struct line *l, void *arg) {
+	return l->len == *(size_t *)arg;
+}
+static unsigned check_fixedkeylinelen(struct instance *inst, char **answer) {
+	// "... one line in that file that is exactly N characters long."
+	char *p = strstr(inst->readme, "exactly ");
+	size_t want;
+	if (!p || sscanf(p, "exactly %zu characters", &want) != 1)
+		return 0;
+	return countlines(inst, _haslen, &want, answer);
+}
+
+static unsigned check_longestline(struct instance *inst, char **answer) {
+	char *buf;
+	size_t nlines;
+	struct line *lines = readlines(inst, &nlines, &buf);
+	size_t longest = 0;
+	for (size_t i = 0; i < nlines; i++) {
+		if (lines[i].len > longest)
+			longest = lines[i].len;
+	}
+	free(lines);
+	free(buf);
+	return countlines(inst, _haslen, &longest, answer);
+}
+
+static int _evenlen(struct line *l, void *unused) {
+	return l->len % 2 == 0;
+}
+static unsigned check_evenline(struct instance *inst, char **answer) {
+	return countlines(inst, _evenlen, NULL, answer);
+}
+
+static unsigned check_concatposns(struct instance *inst, char **answer) {
+	char *buf;
+	size_t nlines;
+	struct line *lines = readlines(inst, &nlines, &buf);
+	// "N lines of equal length have been written to 'files/lines'. ..."
+	unsigned want;
+	unsigned ok = sscanf(inst->readme, "%u lines of equal length", &want) == 1
+		&& nlines == want;
+	*answer = MUST(malloc(nlines + 1));
+	for (size_t i = 0; i < nlines; i++) {
+		if (lines[i].len <= i)
+			ok = 0;
+		(*answer)[i] = lines[i].len > i ? lines[i].s[i] : '?';
+	}
+	(*answer)[nlines] = '\0';
+	free(lines);
+	free(buf);
+	return ok;
+}
+
+static unsigned check_mostrecentfile(struct instance *inst, char **answer) {
+	DIR *dir = opendirat(inst->filesdir);
+	struct dirent *ent;
+	struct timespec newest = { 0 };
+	unsigned n = 0;
+	while ((ent = readdir(dir)) != NULL) {
+		if (ent->d_name[0] == '.')
+			continue;
+		struct stat st;
+		MUST(fstatat(inst->filesdir, ent->d_name, &st, 0));
+		if (st.st_mtim.tv_sec > newest.tv_sec
+			|| (st.st_mtim.tv_sec == newest.tv_sec && st.st_mtim.tv_nsec > newest.tv_nsec)) {
+			newest = st.st_mtim;
+			n = 0;
+		}
+		if (st.st_mtim.tv_sec == newest.tv_sec && st.st_mtim.tv_nsec == newest.tv_nsec) {
+			n++;
+			free(*answer);
+			*answer = MUST(strdup(ent->d_name));
+		}
+	}
+	closedir(dir);
+	return n;
+}
+
+static unsigned check_filenamesuffix(struct instance *inst, char **answer) {
+	DIR *dir = opendirat(inst->filesdir);
+	struct dirent *ent;
+	unsigned n = 0;
+	while ((ent = readdir(dir)) != NULL) {
+		size_t len = strlen(ent->d_name);
+		if (len >= 3 && !strcmp(ent->d_name + len - 3, "abc")) {
+			n++;
+			free(*answer);
+			*answer = MUST(strdup(ent->d_name));
+		}
+	}
+	closedir(dir);
+	return n;
+}
+
+// looked up by impl; the levels themselves come from g_levels
+static struct {
+	lvl_impl_t impl;
+	checker_t check;
+} checkers[] = {
+	{ lvlimpl_onboarding, check_onboarding },
+	{ lvlimpl_digitline, check_digitline },
+	{ lvlimpl_filenamesuffix, check_filenamesuffix },
+	{ lvlimpl_fixedkeylinelen, check_fixedkeylinelen },
+	{ lvlimpl_longestline, check_longestline },
+	{ lvlimpl_evenline, check_evenline },
+	{ lvlimpl_mostrecentfile, check_mostrecentfile },
+	{ lvlimpl_concatposns, check_concatposns },
+};
+
+// NULL for a level nobody has written a checker for yet, which then fails
+static checker_t checkerfor(lvl_impl_t impl) {
+	for (int i = 0; i < ARRAY_LEN(checkers); i++) {
+		if (checkers[i].impl == impl)
+			return checkers[i].check;
+	}
+	return NULL;
+}
+
+// Brackets each generation in the traced child; none of the levels
+// ever call it.
+#define MARKER SYS_getppid
+#define MAXSYSCALL 512
+
+static struct {
+	long nr;
+	char *name;
+} sysnames[] = {
+	{ SYS_openat, "openat" },
+	{ SYS_close, "close" },
+	{ SYS_read, "read" },
+	{ SYS_write, "write" },
+	{ SYS_pwrite64, "pwrite64" },
+	{ SYS_lseek, "lseek" },
+	{ SYS_utimensat, "utimensat" },
+	{ SYS_mkdirat, "mkdirat" },
+	{ SYS_unlinkat, "unlinkat" },
+	{ SYS_getdents64, "getdents64" },
+	{ SYS_brk, "brk" },
+	{ SYS_mmap, "mmap" },
+	{ SYS_munmap, "munmap" },
+	{ SYS_getrandom, "getrandom" },
+#ifdef SYS_fstat
+	{ SYS_fstat, "fstat" },
+#endif
+#ifdef SYS_newfstatat
+	{ SYS_newfstatat, "newfstatat" },
+#endif
+};
+
+static char *sysname(long nr) {
+	static char buf[32];
+	for (int i = 0; i < ARRAY_LEN(sysnames); i++) {
+		if (sysnames[i].nr == nr)
+			return sysnames[i].name;
+	}
+	snprintf(buf, sizeof(buf), "sys%ld", nr);
+	return buf;
+}
+
+static int cmpstr(const void *a, const void *b) {
+	return strcmp(*(char **)a, *(char **)b);
+}
+
+// Hashes everything a player would see of an instance: the README, and
+// the names and contents of the files (but not the mtimes, which come
+// from the clock), along with the secret.
+static void hashinstance(int dirfd, int filesdir, char *secret, unsigned char out[DIGEST_LEN]) {
+	char *buf;
+	size_t buflen;
+	FILE *mem = MUST(open_memstream(&buf, &buflen));
+	fwrite(secret, 1, strlen(secret) + 1, mem);
+	size_t len;
+	char *contents = readfileat(dirfd, "README", &len);
+	fwrite(contents, 1, len + 1, mem);
+	free(contents);
+
+	// in name order; the directory order isn't up to the level
+	size_t nnames = 0, cap = 64;
+	char **names = MUST(malloc(cap * sizeof(*names)));
+	DIR *dir = opendirat(filesdir);
+	struct dirent *ent;
+	while ((ent = readdir(dir)) != NULL) {
+		if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+			continue;
+		if (nnames == cap) {
+			cap *= 2;
+			names = MUST(realloc(names, cap * sizeof(*names)));
+		}
+		names[nnames++] = MUST(strdup(ent->d_name));
+	}
+	closedir(dir);
+	qsort(names, nnames, sizeof(*names), cmpstr);
+	for (size_t i = 0; i < nnames; i++) {
+		contents = readfileat(filesdir, names[i], &len);
+		fprintf(mem, "%s%c%zu%c", names[i], '\0', len, '\0');
+		fwrite(contents, 1, len, mem);
+		free(contents);
+		free(names[i]);
+	}
+	free(names);
+	MUST(fclose(mem));
+
+	static const unsigned char key[DIGEST_KEYLEN];
+	siphash128(key, buf, buflen, out);
+	free(buf);
+}
+
+// Removes the regular files in dirfd. Returns how many there were, and
+// adds up their sizes in *bytes.
+static unsigned clearfiles(int dirfd, unsigned long long *bytes) {
+	DIR *dir = opendirat(dirfd);
+	struct dirent *ent;
+	unsigned n = 0;
+	while ((ent = readdir(dir)) != NULL) {
+		struct stat st;
+		MUST(fstatat(dirfd, ent->d_name, &st, AT_SYMLINK_NOFOLLOW));
+		if (!S_ISREG(st.st_mode))
+			continue;
+		*bytes += st.st_size;
+		n++;
+		MUST(unlinkat(dirfd, ent->d_name, 0));
+	}
+	closedir(dir);
+	return n;
+}
+
+static long long nsbetween(struct timespec *a, struct timespec *b) {
+	return (b->tv_sec - a->tv_sec) * 1000000000LL + (b->tv_nsec - a->tv_nsec);
+}
+
+// shared with the traced child
+struct tracerun {
+	// set once the child is being traced
+	int traced;
+	// the child's instances
+	unsigned char hashes[][DIGEST_LEN];
+};
+
+// Generates nruns instances of level idx from seed, hashing each one into
+// tr, with each generation bracketed by MARKER syscalls. Doesn't return.
+static void tracedchild(int idx, int scratch, unsigned nruns, unsigned long long seed,
+		struct tracerun *tr) {
+	// if we can't be traced, still check that the instances are the same
+	if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) == 0) {
+		tr->traced = 1;
+		raise(SIGSTOP);
+	}
+	rand_seed(seed);
+	unsigned long long bytes = 0;
+	for (unsigned run = 0; run < nruns; run++) {
+		int readmefd = MUST(openat(scratch, "README", O_CREAT|O_EXCL|O_WRONLY, 0644));
+		mkdirat(scratch, "files", 0755);
+		int filesdir = MUST(openat(scratch, "files", O_DIRECTORY));
+		syscall(MARKER);
+		char *secret = (*g_levels[idx].impl)(readmefd, filesdir, idx + 1);
+		syscall(MARKER);
+		close(readmefd);
+		hashinstance(scratch, filesdir, secret, tr->hashes[run]);
+		clearfiles(filesdir, &bytes);
+		clearfiles(scratch, &bytes);
+		close(filesdir);
+	}
+	_exit(0);
+}
+
+// Runs the traced child to the end, adding up the syscalls it makes
+// between MARKERs in count[] (by syscall number). Returns 0 if the child
+// failed.
+static int countsyscalls(pid_t pid, unsigned long long *count) {
+	int status;
+	int inside = 0;
+	for (;;) {
+		MUST(waitpid(pid, &status, 0));
+		if (!WIFSTOPPED(status))
+			break;
+		int sig = 0;
+		if (WSTOPSIG(status) == (SIGTRAP|0x80)) {
+			struct __ptrace_syscall_info info;
+			MUST(ptrace(PTRACE_GET_SYSCALL_INFO, pid, sizeof(info), &info));
+			if (info.op == PTRACE_SYSCALL_INFO_ENTRY) {
+				if (info.entry.nr == MARKER)
+					inside = !inside;
+				else if (inside && info.entry.nr < MAXSYSCALL)
+					count[info.entry.nr]++;
+			}
+		} else if (WSTOPSIG(status) == SIGSTOP) {
+			// the child stopping itself, right after PTRACE_TRACEME
+			MUST(ptrace(PTRACE_SETOPTIONS, pid, NULL, PTRACE_O_TRACESYSGOOD|PTRACE_O_EXITKILL));
+		} else {
+			sig = WSTOPSIG(status);
+		}
+		MUST(ptrace(PTRACE_SYSCALL, pid, NULL, sig));
+	}
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+static void printsyscalls(unsigned long long *count, unsigned nruns) {
+	printf("%-16s syscalls/gen:", "");
+	// the top few, biggest first
+	for (int i = 0; i < 6; i++) {
+		long top = -1;
+		for (long nr = 0; nr < MAXSYSCALL; nr++) {
+			if (count[nr] && (top == -1 || count[nr] > count[top]))
+				top = nr;
+		}
+		if (top == -1)
+			break;
+		printf("%s %s %.1f", i ? "," : "", sysname(top), (double)count[top] / nruns);
+		count[top] = 0;
+	}
+	putchar('\n');
+}
+
+// returns the number of bad instances
+static unsigned benchlevel(int idx, int scratch, unsigned nruns, unsigned long long seed) {
+	unsigned nbad = 0;
+	long long totalns = 0;
+	long long solvens = 0;
+	unsigned long long bytes = 0, nfiles = 0;
+	unsigned char (*hashes)[DIGEST_LEN] = MUST(malloc(nruns * sizeof(*hashes)));
+	checker_t check = checkerfor(g_levels[idx].impl);
+	rand_seed(seed);
+	for (unsigned run = 0; run < nruns; run++) {
+		struct instance inst = { .dirfd = scratch };
+		int readmefd = MUST(openat(scratch, "README", O_CREAT|O_EXCL|O_WRONLY, 0644));
+		mkdirat(scratch, "files", 0755);
+		inst.filesdir = MUST(openat(scratch, "files", O_DIRECTORY));
+
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		char *secret = (*g_levels[idx].impl)(readmefd, inst.filesdir, idx + 1);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		totalns += nsbetween(&start, &end);
+		close(readmefd);
+		hashinstance(scratch, inst.filesdir, secret, hashes[run]);
+
+		inst.readme = readfileat(scratch, "README", NULL);
+		char *answer = NULL;
+		unsigned nanswers = check ? (*check)(&inst, &answer) : 0;
+		if (nanswers != 1 || !answer || strcmp(answer, secret)) {
+			if (nbad < 3) {
+				printf("%s: run %u has %u answer(s), '%s', but the secret is '%s'\n",
+					g_levels[idx].name, run, nanswers, answer ? answer : "", secret);
+			}
+			nbad++;
+		}
+		free(answer);
+
+		// the reference solver has to agree, too
+		struct solvestats stats = { 0 };
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		char *solved = solvelevel(g_levels[idx].impl, inst.filesdir, inst.readme, &stats);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		solvens += nsbetween(&start, &end);
+		if (!solved || strcmp(solved, secret)) {
+			if (nbad < 3) {
+				printf("%s: run %u was solved as '%s', but the secret is '%s'\n",
+					g_levels[idx].name, run, solved ? solved : "", secret);
+			}
+			nbad++;
+		}
+		free(solved);
+		free(inst.readme);
+
+		nfiles += clearfiles(inst.filesdir, &bytes);
+		clearfiles(scratch, &bytes);
+		close(inst.filesdir);
+	}
+
+	// again, traced, and the same seed has to give the same instances
+	size_t trsize = sizeof(struct tracerun) + nruns * DIGEST_LEN;
+	struct tracerun *tr = MUST(mmap(NULL, trsize, PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_ANONYMOUS, -1, 0));
+	static unsigned long long count[MAXSYSCALL];
+	memset(count, 0, sizeof(count));
+	fflush(stdout);
+	pid_t pid = MUST(fork());
+	if (pid == 0)
+		tracedchild(idx, scratch, nruns, seed, tr);
+	if (!countsyscalls(pid, count)) {
+		printf("%s: traced run failed\n", g_levels[idx].name);
+		nbad++;
+	} else {
+		unsigned ndiffer = 0;
+		for (unsigned run = 0; run < nruns; run++) {
+			if (memcmp(hashes[run], tr->hashes[run], DIGEST_LEN)) {
+				if (ndiffer < 3)
+					printf("%s: run %u came out different the second time\n", g_levels[idx].name, run);
+				ndiffer++;
+			}
+		}
+		nbad += ndiffer;
+	}
+	unsigned long long nsyscalls = 0;
+	for (int nr = 0; nr < MAXSYSCALL; nr++)
+		nsyscalls += count[nr];
+
+	char syscalls[32] = "-";
+	if (tr->traced)
+		snprintf(syscalls, sizeof(syscalls), "%.1f", (double)nsyscalls / nruns);
+	printf("%-16s %6u %10.1f %11.0f %10.1f %11s %10.1f  %s\n",
+		g_levels[idx].name, nruns,
+		totalns / 1e3 / nruns,
+		(double)bytes / nruns,
+		(double)nfiles / nruns,
+		syscalls,
+		solvens / 1e3 / nruns,
+		nbad ? "FAIL" : "ok");
+	if (tr->traced)
+		printsyscalls(count, nruns);
+	MUST(munmap(tr, trsize));
+	free(hashes);
+	return nbad;
+}
+
+int main(int argc, char **argv) {
+	unsigned nruns = 1000;
+	unsigned long long seed = 1;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+		switch (opt) {
+		case 'n': nruns = strtoul(optarg, NULL, 10); break;
+		case 's': seed = strtoull(optarg, NULL, 10); break;
+		default:
+			fprintf(stderr, "usage: levelbench [-n RUNS] [-s SEED] [LEVEL...]\n");
+			return 1;
+		}
+	}
+	char scratchpath[] = "/tmp/levelbench.XXXXXX";
+	MUST(mkdtemp(scratchpath));
+	int scratch = MUST(open(scratchpath, O_DIRECTORY));
+
+	printf("seed %llu\n", seed);
+	printf("%-16s %6s %10s %11s %10s %11s %10s  %s\n",
+		"level", "runs", "us/gen", "bytes/gen", "files/gen", "sys/gen", "us/solve", "check");
+	unsigned nbad = 0;
+	for (int i = 0; i < g_nlevels; i++) {
+		int wanted = optind == argc;
+		for (int j = optind; j < argc; j++) {
+			if (!strcmp(argv[j], g_levels[i].name))
+				wanted = 1;
+		}
+		if (wanted)
+			nbad += benchlevel(i, scratch, nruns, seed);
+	}
+
+	unlinkat(scratch, "files", AT_REMOVEDIR);
+	close(scratch);
+	rmdir(scratchpath);
+	return nbad ? 1 : 0;
+}
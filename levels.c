@@ -164,10 +164,16 @@ char *lvlimpl_mostrecentfile(int readmefd, int filesdir, unsigned lvlno) {
 
 	time_t now = time(NULL);
 	for (int i = 0; i < nfiles; i++) {
-		randalnum(namebuf, NAMEBUFSIZE);
-		// pfft, what are the chances we make the same
-		// random name twice? let's assume it won't happen.
-		int fd = MUST(openat(filesdir, namebuf, O_CREAT|O_EXCL|O_WRONLY, 0644));
+		int fd;
+		// on the off chance that we make the same random name twice, try again
+		do {
+			randalnum(namebuf, NAMEBUFSIZE);
+			fd = openat(filesdir, namebuf, O_CREAT|O_EXCL|O_WRONLY, 0644);
+		} while (fd == -1 && errno == EEXIST);
+		if (fd == -1) {
+			perror("openat");
+			exit(1);
+		}
 		// dont change the secret file, let it keep the current time
 		if (i != nfiles - 1) {
 			unsigned sec_offset = rand_between(60*2, 60*60*48);
@@ -258,8 +264,26 @@ char *lvlimpl_evenline(int readmefd, int filesdir, unsigned lvlno) {
 #undef MAXLINECHARS
 }
 
+#define NAMELEN 10
+// creates a randomly-named file whose name doesn't end with "abc"
+static void mkdecoy(int filesdir) {
+	char buf[NAMELEN+1];
+	int fd;
+	// a name we already used is just retried
+	do {
+		randalnum(buf, NAMELEN+1);
+		if (buf[NAMELEN-1]=='c'&&buf[NAMELEN-2]=='b'&&buf[NAMELEN-3]=='a')
+			buf[NAMELEN-1] = 'z';
+		fd = openat(filesdir, buf, O_CREAT|O_RDWR|O_EXCL, 0644);
+	} while (fd == -1 && errno == EEXIST);
+	if (fd == -1) {
+		perror("openat");
+		exit(1);
+	}
+	close(fd);
+}
+
 char *lvlimpl_filenamesuffix(int readmefd, int filesdir, unsigned lvlno) {
-	#define NAMELEN 10
 	int nbefore = rand_between(100, 150);
 	int nafter = rand_between(100, 150);
 	static char secret[NAMELEN+1];
@@ -267,22 +291,11 @@ char *lvlimpl_filenamesuffix(int readmefd, int filesdir, unsigned lvlno) {
 	secret[NAMELEN-1] = 'c';
 	secret[NAMELEN-2] = 'b';
 	secret[NAMELEN-3] = 'a';
-	char buf[NAMELEN+1];
-	while (--nbefore) {
-		randalnum(buf, NAMELEN+1);
-		if (buf[NAMELEN-1]=='c'&&buf[NAMELEN-2]=='b'&&buf[NAMELEN-3]=='a')
-			buf[NAMELEN-1] = 'z';
-		int fd = openat(filesdir, buf, O_CREAT|O_RDWR|O_EXCL, 0644);
-		close(fd);
-	}
-	MUST(openat(filesdir, secret, O_CREAT|O_RDWR|O_EXCL, 0644));
-	while (--nafter) {
-		randalnum(buf, NAMELEN+1);
-		if (buf[NAMELEN-1]=='c'&&buf[NAMELEN-2]=='b'&&buf[NAMELEN-3]=='a')
-			buf[NAMELEN-1] = 'z';
-		int fd = openat(filesdir, buf, O_CREAT|O_RDWR|O_EXCL, 0644);
-		close(fd);
-	}
+	while (--nbefore)
+		mkdecoy(filesdir);
+	close(MUST(openat(filesdir, secret, O_CREAT|O_RDWR|O_EXCL, 0644)));
+	while (--nafter)
+		mkdecoy(filesdir);
 	dprintf(readmefd,
 		"Several files have been created in the files/ directory. Exactly ONE of those"
 		" files has a filename that ends with \"abc\". That filename is your secret key."
@@ -291,3 +304,15 @@ char *lvlimpl_filenamesuffix(int readmefd, int filesdir, unsigned lvlno) {
 	);
 	return secret;
 }
+
+const struct level g_levels[] = {
+	{ lvlimpl_onboarding, "onboarding" },
+	{ lvlimpl_digitline, "digitline" },
+	{ lvlimpl_filenamesuffix, "filenamesuffix" },
+	{ lvlimpl_fixedkeylinelen, "fixedkeylinelen" },
+	{ lvlimpl_longestline, "longestline" },
+	{ lvlimpl_evenline, "evenline" },
+	{ lvlimpl_mostrecentfile, "mostrecentfile" },
+	{ lvlimpl_concatposns, "concatposns" },
+};
+const size_t g_nlevels = ARRAY_LEN(g_levels);
@@ -1,6 +1,8 @@
 #ifndef __HAVE_LEVELS_H
 #define __HAVE_LEVELS_H
 
+#include <stddef.h>
+
 // return value is the secret key
 typedef char *(*lvl_impl_t)(int readmefd, int filesdir, unsigned lvlno);
 
@@ -13,4 +15,16 @@ char *lvlimpl_concatposns(int readmefd, int filesdir, unsigned lvlno);
 char *lvlimpl_evenline(int readmefd, int filesdir, unsigned lvlno);
 char *lvlimpl_filenamesuffix(int readmefd, int filesdir, unsigned lvlno);
 
+struct level {
+	lvl_impl_t impl;
+	// short name, e.g. "longestline"
+	char *name;
+};
+
+// Every level, in the order they're played: level N is g_levels[N - 1].
+// New levels *must* be added to the end, otherwise it will bump people's
+// most recently completed level and they will end up having to redo it.
+extern const struct level g_levels[];
+extern const size_t g_nlevels;
+
 #endif
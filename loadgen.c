@@ -0,0 +1,478 @@
+// loadgen: runs many simulated players against a scratch instance of the
+// game at once, using the real runme binary, and reports how it held up.
+//
+//     make loadgen && ./loadgen -n 64 -a 20 -m 4:3:2:1
+//
+// Each player is a process that runs `runme` over and over with a random
+// mix of actions. The fake players' uids and the instance directory are
+// passed to runme through KEYHUNT_UID and KEYHUNT_ROOT, which runme only
+// honors when it isn't running with someone else's privileges.
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "db.h"
+#include "lock.h"
+#include "util.h"
+
+// fake uids are UIDBASE + player * (nactions + 1) + k, for the player's
+// k-th "activate"; far above any real account
+#define UIDBASE 3000000000u
+#define WRONGKEY "definitely-not-the-key"
+
+enum action {
+	ACT_STATUS,   // plain `runme`
+	ACT_CLAIM,    // `runme claim` with the right key
+	ACT_WRONG,    // `runme claim` with a wrong key
+	ACT_ACTIVATE, // a brand new player's first `runme`
+	NACTIONS,
+};
+
+static char *actnames[NACTIONS] = {
+	[ACT_STATUS] = "status",
+	[ACT_CLAIM] = "claim",
+	[ACT_WRONG] = "wrong-claim",
+	[ACT_ACTIVATE] = "activate",
+};
+
+struct sample {
+	enum action act;
+	int killed;
+	int exitcode;
+	long long latency_ns;
+	// -1 if runme never got as far as the lock
+	long long lockwait_ns;
+};
+
+static char *g_runme = "./runme";
+static char g_root[] = "/tmp/keyhunt-load.XXXXXX";
+static int g_ttyfd;
+static int g_devnull;
+static unsigned g_nplayers = 32;
+static unsigned g_nactions = 20;
+static unsigned g_mix[NACTIONS] = { 4, 3, 2, 1 };
+
+static long long nsbetween(struct timespec *a, struct timespec *b) {
+	return (b->tv_sec - a->tv_sec) * 1000000000LL + (b->tv_nsec - a->tv_nsec);
+}
+
+static void runcmd(uid_t uid, char *claimkey, struct sample *out) {
+	int errpipe[2];
+	MUST(pipe(errpipe));
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pid_t pid = MUST(fork());
+	if (pid == 0) {
+		char uidstr[32];
+		snprintf(uidstr, sizeof(uidstr), "%lu", (unsigned long)uid);
+		setenv("KEYHUNT_ROOT", g_root, 1);
+		setenv("KEYHUNT_UID", uidstr, 1);
+		setenv("KEYHUNT_LOCKSTATS", "1", 1);
+		// runme refuses to run without a tty unless it's given a claim
+		dup2(g_ttyfd, 0);
+		dup2(g_devnull, 1);
+		dup2(errpipe[1], 2);
+		close(errpipe[0]);
+		close(errpipe[1]);
+		if (claimkey)
+			execl(g_runme, g_runme, "claim", claimkey, (char *)NULL);
+		else
+			execl(g_runme, g_runme, (char *)NULL);
+		_exit(127);
+	}
+	close(errpipe[1]);
+
+	char errbuf[4096];
+	size_t errlen = 0;
+	ssize_t nread;
+	while ((nread = read(errpipe[0], errbuf + errlen, sizeof(errbuf) - 1 - errlen)) > 0) {
+		errlen += nread;
+		if (errlen == sizeof(errbuf) - 1)
+			errlen = 0; // only the tail matters
+	}
+	errbuf[errlen] = '\0';
+	close(errpipe[0]);
+
+	int status;
+	MUST(waitpid(pid, &status, 0));
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	out->latency_ns = nsbetween(&start, &end);
+	out->killed = WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL;
+	out->exitcode = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+	char *lw = strstr(errbuf, "lockwait_ns: ");
+	out->lockwait_ns = lw ? atoll(lw + strlen("lockwait_ns: ")) : -1;
+}
+
+static char *readdbfile(size_t *len) {
+	char path[sizeof(g_root) + 8];
+	snprintf(path, sizeof(path), "%s/db", g_root);
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		*len = 0;
+		return NULL;
+	}
+	struct stat st;
+	MUST(fstat(fd, &st));
+	char *buf = MUST(malloc(st.st_size + 1));
+	ssize_t nread = MUST(read(fd, buf, st.st_size));
+	close(fd);
+	*len = nread;
+	return buf;
+}
+
+// Solves the level in uid's directory the way a player would, with
+// `runme solve`. Returns the key, or NULL if that failed.
+static char *solvekey(uid_t uid) {
+	char dir[sizeof(g_root) + 64];
+	snprintf(dir, sizeof(dir), "%s/play/uid%lu", g_root, (unsigned long)uid);
+	int outpipe[2];
+	MUST(pipe(outpipe));
+	pid_t pid = MUST(fork());
+	if (pid == 0) {
+		dup2(outpipe[1], 1);
+		dup2(g_devnull, 2);
+		close(outpipe[0]);
+		close(outpipe[1]);
+		execl(g_runme, g_runme, "solve", dir, (char *)NULL);
+		_exit(127);
+	}
+	close(outpipe[1]);
+
+	char buf[4096];
+	size_t len = 0;
+	ssize_t nread;
+	while ((nread = read(outpipe[0], buf + len, sizeof(buf) - 1 - len)) > 0)
+		len += nread;
+	buf[len] = '\0';
+	close(outpipe[0]);
+
+	int status;
+	MUST(waitpid(pid, &status, 0));
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		return NULL;
+	buf[strcspn(buf, "\n")] = '\0';
+	return MUST(strdup(buf));
+}
+
+struct _findkey_arg {
+	uid_t uid;
+	unsigned numunlocked;
+	unsigned numcomplete;
+};
+static void _findkey_iter(struct dbent *ent, void *uarg) {
+	struct _findkey_arg *arg = uarg;
+	if (ent->kind == 'u' && ent->ku.uid == arg->uid)
+		arg->numunlocked++;
+	else if (ent->kind == 'c' && ent->kc.uid == arg->uid)
+		arg->numcomplete++;
+}
+// Key of uid's level in progress, or NULL. The db only has digests of the
+// keys, so it's only used to see whether there is a level in progress,
+// and is read without the lock (like an admin would), so it may be
+// missing the latest appends.
+static char *findkey(uid_t uid) {
+	size_t len;
+	char *buf = readdbfile(&len);
+	if (!buf)
+		return NULL;
+	struct _findkey_arg arg = { .uid = uid };
+	parsedb(buf, len, _findkey_iter, &arg);
+	free(buf);
+	if (arg.numunlocked == 0 || arg.numcomplete == arg.numunlocked)
+		return NULL;
+	return solvekey(uid);
+}
+
+static enum action pickaction(unsigned *seed) {
+	unsigned total = 0;
+	for (int i = 0; i < NACTIONS; i++)
+		total += g_mix[i];
+	unsigned r = rand_r(seed) % total;
+	for (int i = 0; i < NACTIONS; i++) {
+		if (r < g_mix[i])
+			return i;
+		r -= g_mix[i];
+	}
+	return ACT_STATUS;
+}
+
+static void player(unsigned idx, struct sample *samples, int startfd, unsigned seed) {
+	// wait for the starting gun, so everyone arrives at once
+	char c;
+	read(startfd, &c, 1);
+
+	unsigned nactivated = 0;
+	uid_t uid = UIDBASE + idx * (g_nactions + 1);
+	for (unsigned i = 0; i < g_nactions; i++) {
+		enum action act = pickaction(&seed);
+		char *key = NULL;
+		if (act == ACT_ACTIVATE) {
+			uid = UIDBASE + idx * (g_nactions + 1) + ++nactivated;
+		} else if (act == ACT_CLAIM) {
+			key = findkey(uid);
+			// nothing to claim yet, so just show up
+			if (!key)
+				act = ACT_STATUS;
+		} else if (act == ACT_WRONG) {
+			key = WRONGKEY;
+		}
+		samples[i].act = act;
+		runcmd(uid, key, &samples[i]);
+		if (act == ACT_CLAIM)
+			free(key);
+	}
+}
+
+static int cmpll(const void *a, const void *b) {
+	long long x = *(long long *)a, y = *(long long *)b;
+	return (x > y) - (x < y);
+}
+
+static double pctl(long long *sorted, size_t n, double p) {
+	if (n == 0)
+		return 0;
+	size_t i = (size_t)(p / 100 * (n - 1) + 0.5);
+	return sorted[i] / 1e6;
+}
+
+static void report(struct sample *samples, size_t nsamples, long long wall_ns) {
+	long long *lat = MUST(malloc(nsamples * sizeof(*lat)));
+	long long *wait = MUST(malloc(nsamples * sizeof(*wait)));
+
+	printf("%zu runs by %u players in %.3f s: %.1f runs/s\n\n",
+		nsamples, g_nplayers, wall_ns / 1e9, nsamples / (wall_ns / 1e9));
+	printf("%-12s %6s %9s %9s %9s %9s %7s %7s %7s\n",
+		"action", "runs", "p50 ms", "p90 ms", "p99 ms", "max ms", "killed", "busy", "failed");
+	for (int act = -1; act < NACTIONS; act++) {
+		size_t n = 0, nkilled = 0, nbusy = 0, nfailed = 0;
+		for (size_t i = 0; i < nsamples; i++) {
+			if (act != -1 && samples[i].act != act)
+				continue;
+			lat[n++] = samples[i].latency_ns;
+			if (samples[i].killed)
+				nkilled++;
+			else if (samples[i].exitcode == EXIT_BUSY)
+				nbusy++;
+			else if (samples[i].exitcode != 0)
+				nfailed++;
+		}
+		qsort(lat, n, sizeof(*lat), cmpll);
+		printf("%-12s %6zu %9.2f %9.2f %9.2f %9.2f %7zu %7zu %7zu\n",
+			act == -1 ? "all" : actnames[act], n,
+			pctl(lat, n, 50), pctl(lat, n, 90), pctl(lat, n, 99), pctl(lat, n, 100),
+			nkilled, nbusy, nfailed);
+	}
+
+	size_t nwait = 0;
+	long long totalwait = 0;
+	for (size_t i = 0; i < nsamples; i++) {
+		if (samples[i].lockwait_ns >= 0) {
+			wait[nwait++] = samples[i].lockwait_ns;
+			totalwait += samples[i].lockwait_ns;
+		}
+	}
+	qsort(wait, nwait, sizeof(*wait), cmpll);
+	printf("\nlock wait: %zu runs took the lock, total %.1f ms,"
+		" p50 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+		nwait, totalwait / 1e6,
+		pctl(wait, nwait, 50), pctl(wait, nwait, 99), pctl(wait, nwait, 100));
+
+	free(lat);
+	free(wait);
+}
+
+struct plrstate {
+	unsigned numunlocked;
+	unsigned numcomplete;
+};
+struct _check_iter_arg {
+	struct plrstate *plrs;
+	size_t nplrs;
+	size_t nrecords;
+	size_t nerrors;
+	unsigned long long lastts;
+};
+static void _check_iter(struct dbent *ent, void *uarg) {
+	struct _check_iter_arg *arg = uarg;
+	uid_t uid = ent->kind == 'u' ? ent->ku.uid : ent->kc.uid;
+	unsigned lvl = ent->kind == 'u' ? ent->ku.lvl : ent->kc.lvl;
+	arg->nrecords++;
+	if (uid < UIDBASE || uid - UIDBASE >= arg->nplrs) {
+		printf("record %zu: unexpected uid %lu\n", arg->nrecords, (unsigned long)uid);
+		arg->nerrors++;
+		return;
+	}
+	if (ent->ts < arg->lastts) {
+		printf("record %zu: timestamp %llu is before the previous record's, %llu\n",
+			arg->nrecords, ent->ts, arg->lastts);
+		arg->nerrors++;
+	}
+	arg->lastts = ent->ts;
+	struct plrstate *p = &arg->plrs[uid - UIDBASE];
+	if (ent->kind == 'u') {
+		if (lvl != p->numunlocked + 1 || p->numcomplete != p->numunlocked) {
+			printf("record %zu: uid %lu unlocked level %u with %u/%u complete\n",
+				arg->nrecords, (unsigned long)uid, lvl, p->numcomplete, p->numunlocked);
+			arg->nerrors++;
+		}
+		p->numunlocked++;
+	} else {
+		if (lvl != p->numunlocked || p->numcomplete + 1 != p->numunlocked) {
+			printf("record %zu: uid %lu completed level %u with %u/%u complete\n",
+				arg->nrecords, (unsigned long)uid, lvl, p->numcomplete, p->numunlocked);
+			arg->nerrors++;
+		}
+		p->numcomplete++;
+	}
+}
+
+// Every record must be whole and every player's history must be a legal
+// sequence of unlocks and completions. Each player with a level in
+// progress must also have that level's README.
+static int checkdb(void) {
+	size_t len;
+	char *buf = readdbfile(&len);
+	struct _check_iter_arg arg = {
+		.nplrs = g_nplayers * (g_nactions + 1),
+	};
+	arg.plrs = MUST(calloc(arg.nplrs, sizeof(*arg.plrs)));
+	size_t parsed = buf ? parsedb(buf, len, _check_iter, &arg) : 0;
+	if (parsed != len) {
+		printf("db has %zu trailing bytes of a partial record\n", len - parsed);
+		arg.nerrors++;
+	}
+
+	size_t nplaying = 0;
+	for (size_t i = 0; i < arg.nplrs; i++) {
+		struct plrstate *p = &arg.plrs[i];
+		if (p->numunlocked == 0)
+			continue;
+		nplaying++;
+		if (p->numunlocked == p->numcomplete)
+			continue;
+		char path[sizeof(g_root) + 64];
+		snprintf(path, sizeof(path), "%s/play/uid%lu/README.lvl-%u",
+			g_root, (unsigned long)(UIDBASE + i), p->numunlocked);
+		if (access(path, F_OK) == -1) {
+			printf("missing %s\n", path);
+			arg.nerrors++;
+		}
+	}
+	printf("db check: %zu records, %zu players, %zu problems\n",
+		arg.nrecords, nplaying, arg.nerrors);
+
+	free(arg.plrs);
+	free(buf);
+	return arg.nerrors == 0;
+}
+
+static int rmentry(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+	return remove(path);
+}
+
+static void usage(void) {
+	fprintf(stderr,
+		"usage: loadgen [-n PLAYERS] [-a ACTIONS] [-m STATUS:CLAIM:WRONG:ACTIVATE]\n"
+		"               [-b RUNME] [-s SEED] [-k]\n"
+		"    -n  number of concurrent players (default %u)\n"
+		"    -a  runs per player (default %u)\n"
+		"    -m  relative weights of each action (default %u:%u:%u:%u)\n"
+		"    -b  path to the runme binary (default %s)\n"
+		"    -s  random seed\n"
+		"    -k  keep the scratch instance directory\n"
+		, g_nplayers, g_nactions
+		, g_mix[0], g_mix[1], g_mix[2], g_mix[3]
+		, g_runme
+	);
+	exit(1);
+}
+
+int main(int argc, char **argv) {
+	unsigned seed = time(NULL);
+	int keep = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:a:m:b:s:k")) != -1) {
+		switch (opt) {
+		case 'n': g_nplayers = strtoul(optarg, NULL, 10); break;
+		case 'a': g_nactions = strtoul(optarg, NULL, 10); break;
+		case 'b': g_runme = optarg; break;
+		case 's': seed = strtoul(optarg, NULL, 10); break;
+		case 'k': keep = 1; break;
+		case 'm':
+			if (sscanf(optarg, "%u:%u:%u:%u", &g_mix[0], &g_mix[1], &g_mix[2], &g_mix[3]) != 4)
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc || g_nplayers == 0 || g_nactions == 0
+		|| g_mix[0] + g_mix[1] + g_mix[2] + g_mix[3] == 0)
+		usage();
+	if (access(g_runme, X_OK) == -1) {
+		perror(g_runme);
+		return 1;
+	}
+
+	MUST(mkdtemp(g_root));
+	printf("instance: %s, seed: %u\n", g_root, seed);
+
+	g_ttyfd = MUST(posix_openpt(O_RDWR|O_NOCTTY));
+	MUST(grantpt(g_ttyfd));
+	MUST(unlockpt(g_ttyfd));
+	int ptyslave = MUST(open(ptsname(g_ttyfd), O_RDWR|O_NOCTTY));
+	int ptymaster = g_ttyfd;
+	g_ttyfd = ptyslave;
+	g_devnull = MUST(open("/dev/null", O_WRONLY));
+
+	size_t nsamples = (size_t)g_nplayers * g_nactions;
+	struct sample *samples = MUST(mmap(NULL, nsamples * sizeof(*samples),
+		PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0));
+
+	int startpipe[2];
+	MUST(pipe(startpipe));
+	for (unsigned i = 0; i < g_nplayers; i++) {
+		if (MUST(fork()) == 0) {
+			close(startpipe[1]);
+			player(i, samples + (size_t)i * g_nactions, startpipe[0], seed + i);
+			_exit(0);
+		}
+	}
+	close(startpipe[0]);
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	// go!
+	close(startpipe[1]);
+	int nbadplayers = 0;
+	int status;
+	while (wait(&status) != -1) {
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			nbadplayers++;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (nbadplayers)
+		printf("%d player processes died\n", nbadplayers);
+
+	report(samples, nsamples, nsbetween(&start, &end));
+	int ok = checkdb() && nbadplayers == 0;
+
+	close(ptymaster);
+	if (keep)
+		printf("kept %s\n", g_root);
+	else
+		nftw(g_root, rmentry, 16, FTW_DEPTH|FTW_PHYS);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,234 @@
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lock.h"
+#include "util.h"
+
+/*
+fcntl() locks don't hand the lock to waiters in any particular order;
+every release wakes all of them up to race for it. So before taking the
+db lock we line up in a ticket queue, kept in the "lockqueue" file:
+
+  - the start of the file is a shared struct lockqueue (below);
+  - each waiter takes the next ticket, and write-locks one byte of the
+    file at QSLOT(ticket) until it exits. Both happen while holding the
+    byte at QTICKET, so by the time anyone can get the next ticket, the
+    slot of this one is locked;
+  - it then waits for the byte of the ticket before it to be unlocked,
+    i.e. for its predecessor to exit (or die, or give up), and only then
+    goes for the db lock.
+
+Since the kernel drops a process' locks when it dies, a killed process
+can't wedge the queue.
+*/
+
+struct lockqueue {
+	// next ticket to hand out
+	unsigned long long next;
+	// every ticket before this one has had its turn
+	unsigned long long served;
+	// moving average of how long the lock is held for, for retry hints
+	unsigned hold_us;
+};
+
+#define QTICKET 4095
+#define QSLOT(TICKET) (4096 + (off_t)(TICKET))
+// how often the wait timer goes off again once it has run out
+#define WAITRETRY_MS 10
+
+static struct lockqueue *g_queue;
+static int g_qfd;
+static timer_t g_killtimer;
+static struct timespec g_lockedat;
+static unsigned long long g_ticket;
+
+static struct timespec mstots(unsigned ms) {
+	return (struct timespec) {
+		.tv_sec = ms / 1000,
+		.tv_nsec = ms % 1000 * 1000000,
+	};
+}
+
+// goes off after ms, and then every intervalms if that isn't 0
+static void settimer2(timer_t timer, unsigned ms, unsigned intervalms) {
+	struct itimerspec spec = {
+		.it_value = mstots(ms),
+		.it_interval = mstots(intervalms),
+	};
+	MUST(timer_settime(timer, 0, &spec, NULL));
+}
+
+static void settimer(timer_t timer, unsigned ms) {
+	settimer2(timer, ms, 0);
+}
+
+static volatile sig_atomic_t g_waitexpired;
+
+static void waitexpired_handler(int sig) {
+	g_waitexpired = 1;
+}
+
+static void busy(void) {
+	unsigned long long served = __atomic_load_n(&g_queue->served, __ATOMIC_RELAXED);
+	unsigned long long ahead = g_ticket > served ? g_ticket - served : 0;
+	unsigned hold_ms = g_queue->hold_us / 1000 + 1;
+	// spread retries out, so we don't all come back at once
+	unsigned retry_ms = (ahead + 1) * hold_ms;
+	retry_ms += rand_lt(retry_ms + 1);
+	printf(
+		"The game is busy right now (about %llu players ahead of you)."
+		" Please try again in %u ms.\n"
+		, ahead
+		, retry_ms
+	);
+	exit(EXIT_BUSY);
+}
+
+// Blocks for lk until the wait timer goes off. Returns 0 if it timed out.
+static int waitlock(int fd, struct flock *lk) {
+	// The timer may have gone off while we weren't blocked, so it didn't
+	// interrupt anything. If it goes off between this check and the
+	// fcntl(), the next one (WAITRETRY_MS later) interrupts it instead.
+	if (g_waitexpired)
+		return 0;
+	if (fcntl(fd, F_SETLKW, lk) == -1) {
+		if (errno == EINTR)
+			return 0;
+		perror("fcntl");
+		exit(1);
+	}
+	return 1;
+}
+
+static void recordhold(void) {
+	// already done by unlockdb()
+	if (!g_queue)
+		return;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	unsigned held_us = (now.tv_sec - g_lockedat.tv_sec) * 1000000
+		+ (now.tv_nsec - g_lockedat.tv_nsec) / 1000;
+	// we still have the db lock here, so nobody else is writing this
+	g_queue->hold_us = (g_queue->hold_us * 7 + held_us) / 8;
+}
+
+static struct lockqueue *openqueue(int *qfd) {
+	*qfd = MUST(open("lockqueue", O_CREAT|O_RDWR, 0600));
+	struct stat st;
+	MUST(fstat(*qfd, &st));
+	// growing it is safe to race on; it's never shrunk
+	if (st.st_size < sizeof(struct lockqueue))
+		MUST(ftruncate(*qfd, sizeof(struct lockqueue)));
+	return MUST(mmap(NULL, sizeof(struct lockqueue), PROT_READ|PROT_WRITE, MAP_SHARED, *qfd, 0));
+}
+
+void lockdb(int dbfd) {
+	// The watchdog. This is to prevent someone from doing a
+	// denial-of-service by e.g. suspending us while we're holding the
+	// db lock (or our place in the queue). It's re-armed with
+	// LOCK_HOLD_MS once we have the lock.
+	struct sigevent killevt = {
+		.sigev_notify = SIGEV_SIGNAL,
+		.sigev_signo = SIGKILL,
+	};
+	MUST(timer_create(CLOCK_MONOTONIC, &killevt, &g_killtimer));
+	settimer(g_killtimer, LOCK_WAIT_MS + LOCK_HOLD_MS);
+
+	// The wait timer interrupts a blocked fcntl(), so we can give up
+	// cleanly. No SA_RESTART, otherwise the fcntl() would keep going.
+	struct sigaction sa = { .sa_handler = waitexpired_handler };
+	MUST(sigaction(SIGALRM, &sa, NULL));
+	timer_t waittimer;
+	struct sigevent waitevt = {
+		.sigev_notify = SIGEV_SIGNAL,
+		.sigev_signo = SIGALRM,
+	};
+	MUST(timer_create(CLOCK_MONOTONIC, &waitevt, &waittimer));
+	settimer2(waittimer, LOCK_WAIT_MS, WAITRETRY_MS);
+
+	int qfd;
+	g_queue = openqueue(&qfd);
+	g_qfd = qfd;
+	struct flock ticketlk = {
+		.l_type = F_WRLCK,
+		.l_whence = SEEK_SET,
+		.l_start = QTICKET,
+		.l_len = 1,
+	};
+	// only ever held for a moment
+	if (!waitlock(qfd, &ticketlk))
+		busy();
+	g_ticket = __atomic_fetch_add(&g_queue->next, 1, __ATOMIC_SEQ_CST);
+	struct flock myslot = {
+		.l_type = F_WRLCK,
+		.l_whence = SEEK_SET,
+		.l_start = QSLOT(g_ticket),
+		.l_len = 1,
+	};
+	// nobody can have this yet; our successor doesn't exist until we let
+	// go of the ticket lock
+	MUST(fcntl(qfd, F_SETLK, &myslot));
+	ticketlk.l_type = F_UNLCK;
+	MUST(fcntl(qfd, F_SETLK, &ticketlk));
+
+	int waiting = 0;
+	if (g_ticket > 0) {
+		struct flock prevslot = {
+			.l_type = F_RDLCK,
+			.l_whence = SEEK_SET,
+			.l_start = QSLOT(g_ticket - 1),
+			.l_len = 1,
+		};
+		if (fcntl(qfd, F_SETLK, &prevslot) == -1) {
+			fputs("Waiting for db lock...\n", stderr);
+			waiting = 1;
+			if (!waitlock(qfd, &prevslot))
+				busy();
+		}
+		prevslot.l_type = F_UNLCK;
+		MUST(fcntl(qfd, F_SETLK, &prevslot));
+	}
+
+	// our predecessor is done, but may not have let go of the db yet
+	struct flock lk = {
+		.l_type = F_WRLCK,
+		.l_whence = SEEK_SET,
+		.l_start = 0,
+		.l_len = 0,
+	};
+	if (fcntl(dbfd, F_SETLK, &lk) == -1) {
+		if (!waiting)
+			fputs("Waiting for db lock...\n", stderr);
+		if (!waitlock(dbfd, &lk))
+			busy();
+	}
+
+	settimer(waittimer, 0);
+	settimer(g_killtimer, LOCK_HOLD_MS);
+	clock_gettime(CLOCK_MONOTONIC, &g_lockedat);
+	__atomic_store_n(&g_queue->served, g_ticket + 1, __ATOMIC_RELAXED);
+	atexit(recordhold);
+}
+
+void unlockdb(int dbfd) {
+	recordhold();
+	MUST(munmap(g_queue, sizeof(*g_queue)));
+	g_queue = NULL;
+	struct flock lk = {
+		.l_type = F_UNLCK,
+		.l_whence = SEEK_SET,
+		.l_start = 0,
+		.l_len = 0,
+	};
+	MUST(fcntl(dbfd, F_SETLK, &lk));
+	// drops our queue slot too, which lets the next in line go
+	close(g_qfd);
+	settimer(g_killtimer, 0);
+}
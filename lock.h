@@ -0,0 +1,23 @@
+#ifndef __HAVE_LOCK_H
+#define __HAVE_LOCK_H
+
+// how long we may hold the db lock before the watchdog SIGKILLs us
+#define LOCK_HOLD_MS 100
+// how long we will queue for the db lock before giving up
+#define LOCK_WAIT_MS 1000
+
+// exit status when we gave up waiting for the lock (EX_TEMPFAIL)
+#define EXIT_BUSY 75
+
+// Takes the exclusive lock on the db, waiting in FIFO order behind other
+// runme processes for at most LOCK_WAIT_MS. If that runs out, prints a
+// "try again later" message and exits with EXIT_BUSY. Once the lock is
+// taken, the process has LOCK_HOLD_MS to finish before it is killed.
+void lockdb(int dbfd);
+
+// Lets go of the lock taken by lockdb() and disarms the watchdog, for
+// work after the last db update that may take a while (like writing out
+// a lot of results).
+void unlockdb(int dbfd);
+
+#endif
@@ -1,69 +1,49 @@
 #include <dirent.h>
 #include <fcntl.h>
 #include <pwd.h>
-#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/inotify.h>
 #include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "db.h"
+#include "digest.h"
+#include "export.h"
+#include "instance.h"
 #include "levels.h"
+#include "lock.h"
+#include "names.h"
+#include "solve.h"
+#include "stats.h"
+#include "uidtab.h"
 #include "util.h"
 
-struct dbent {
-	char kind;
-
-	union {
-		// kind 'u':
-		struct {
-			uid_t uid;
-			unsigned lvl;
-			char *secret;
-		} ku;
-
-		// kind 'c':
-		struct {
-			uid_t uid;
-			unsigned lvl;
-		} kc;
-	};
-};
-
 // global variables :-)
 static int g_dbfd = -1;
 static char *g_dbcontent;
 static size_t g_dbsize;
 static uid_t g_myuid;
 static int g_playerdir;
+// report time spent waiting for the db lock on stderr (for loadgen)
+static int g_lockstats;
 
-// NOTE: new levels *must* be added to the end,
-// otherwise it will bump people's most recently completed
-// level and they will end up having to redo it.
-static lvl_impl_t levelimpls[] = {
-	lvlimpl_onboarding,
-	lvlimpl_digitline,
-	lvlimpl_filenamesuffix,
-	lvlimpl_fixedkeylinelen,
-	lvlimpl_longestline,
-	lvlimpl_evenline,
-	lvlimpl_mostrecentfile,
-	lvlimpl_concatposns,
-};
-
+// Opens and locks the db on first use, and (re)loads its contents.
+// Nothing before the first call touches the db or its lock, so paths
+// that bail out early (bad arguments, help, etc.) stay cheap.
 static void opendb(void) {
 	if (g_dbfd == -1) {
 		g_dbfd = MUST(open("db", O_CREAT|O_APPEND|O_RDWR, 0600));
-		struct flock lk = {
-			.l_type = F_WRLCK,
-			.l_whence = SEEK_SET,
-			.l_start = 0,
-			.l_len = 0,
-		};
-		if (fcntl(g_dbfd, F_SETLK, &lk) == -1) {
-			fputs("Waiting for db lock...\n", stderr);
-			MUST(fcntl(g_dbfd, F_SETLKW, &lk));
+		struct timespec waitstart, waitend;
+		clock_gettime(CLOCK_MONOTONIC, &waitstart);
+		lockdb(g_dbfd);
+		clock_gettime(CLOCK_MONOTONIC, &waitend);
+		if (g_lockstats) {
+			fprintf(stderr, "lockwait_ns: %lld\n",
+				(waitend.tv_sec - waitstart.tv_sec) * 1000000000LL
+				+ (waitend.tv_nsec - waitstart.tv_nsec));
 		}
 	} else {
 		lseek(g_dbfd, 0, SEEK_SET);
@@ -80,125 +60,106 @@ static void opendb(void) {
 	}
 }
 
-static void insertdb(struct dbent *ent) {
-	// TODO: g_dbfd should really be FILE*...
-	// TODO: this is bad unbuffered like this
-	if (ent->kind == 'u') {
-		dprintf(g_dbfd, "u%lu", (unsigned long)ent->ku.uid);
-		MUST(write(g_dbfd, "\0", 1));
-
-		dprintf(g_dbfd, "%u", ent->ku.lvl);
-		MUST(write(g_dbfd, "\0", 1));
+static void needdb(void) {
+	if (g_dbfd == -1)
+		opendb();
+}
 
-		write(g_dbfd, ent->ku.secret, strlen(ent->ku.secret));
-		MUST(write(g_dbfd, "\0", 1));
+// wall-clock time in ms since the epoch
+static unsigned long long nowms(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	return now.tv_sec * 1000ULL + now.tv_nsec / 1000000;
+}
 
-		MUST(write(g_dbfd, "\n", 1));
-	} else if (ent->kind == 'c') {
-		dprintf(g_dbfd, "c%lu", (unsigned long)ent->kc.uid);
-		MUST(write(g_dbfd, "\0", 1));
+// appends all of ents to the db with a single write(), timestamping them
+static void insertdb_many(struct dbent *ents, size_t nents) {
+	needdb();
+	// timestamps never go backwards, even if the clock does
+	unsigned long long ts = nowms();
+	unsigned long long lastts = lastdbts(g_dbcontent, g_dbsize);
+	if (ts < lastts)
+		ts = lastts;
+	for (size_t i = 0; i < nents; i++)
+		ents[i].ts = ts;
 
-		dprintf(g_dbfd, "%u", ent->kc.lvl);
-		MUST(write(g_dbfd, "\0", 1));
+	char *buf;
+	size_t buflen;
+	FILE *out = MUST(open_memstream(&buf, &buflen));
+	for (size_t i = 0; i < nents; i++)
+		fmtdbent(out, &ents[i]);
+	MUST(fclose(out));
 
-		MUST(write(g_dbfd, "\n", 1));
-	} else {
-		fprintf(stderr, "Unknown kind '%c' for inserted ent\n", ent->kind);
+	if (MUST(write(g_dbfd, buf, buflen)) != buflen) {
+		fputs("short write to db\n", stderr);
 		exit(1);
 	}
+	free(buf);
 
 	opendb();
 }
 
-/*
-db format (each line):
+// Releases the db lock; anything after this that needs the db takes it
+// again.
+static void closedb(void) {
+	if (g_dbfd == -1)
+		return;
+	unlockdb(g_dbfd);
+	close(g_dbfd);
+	g_dbfd = -1;
+}
 
-	uUID\000LVL\000SECRET_KEY\000\n
-	^
-	| 'u' = "unlock" event (user started a new level)
+static void insertdb(struct dbent *ent) {
+	insertdb_many(ent, 1);
+}
 
-	cUID\000LVL\000\n
-	^
-	| 'c' = "completed" event (level passed)
-*/
 static void iter_db(void (*fn)(struct dbent *, void *), void *arg) {
-	if (g_dbsize == 0)
-		return;
-	// points to the last byte of the db contents
-	char *end = g_dbcontent + g_dbsize - 1;
-	char *cur = g_dbcontent;
-
-#define ADD(CUR, AMNT, END) \
-	do { \
-		if (((CUR) += (AMNT)) > (END)) { \
-			fputs("ADDed past END\n", stderr); \
-			exit(1); \
-		} \
-	} while (0)
-
-	while (cur < end) {
-		char evt = *cur;
-		struct dbent ent;
-		ADD(cur, 1, end);
-		// after this if block, cur points to the newline at the end of the just-processed line
-		if (evt == 'u') { // 'unlock' event
-			char *uidstr = cur;
-			ADD(cur, 1 + strlen(uidstr), end);
-
-			char *lvlstr = cur;
-			ADD(cur, 1 + strlen(lvlstr), end);
-
-			char *keystr = cur;
-			ADD(cur, 1 + strlen(keystr), end);
-
-			char *nendptr;
-			uid_t uid = MUST(strtoul(uidstr, &nendptr, 10));
-			if (*nendptr != '\0') {
-				fprintf(stdout, "invalid uid: '%s'\n", uidstr);
-				exit(1);
-			}
-			unsigned lvl = strtoul(lvlstr, &nendptr, 10);
-			if (*nendptr != '\0') {
-				fprintf(stdout, "invalid lvl: '%s'\n", lvlstr);
-				exit(1);
-			}
-			ent.kind = 'u';
-			ent.ku.uid = uid;
-			ent.ku.lvl = lvl;
-			ent.ku.secret = keystr;
-		} else if (evt == 'c') { // 'completed' event
-			char *uidstr = cur;
-			ADD(cur, 1 + strlen(uidstr), end);
+	needdb();
+	// we hold the lock, so there shouldn't be a partially-written record
+	if (parsedb(g_dbcontent, g_dbsize, fn, arg) != g_dbsize) {
+		fputs("db ends with a truncated record\n", stderr);
+		exit(1);
+	}
+}
 
-			char *lvlstr = cur;
-			ADD(cur, 1 + strlen(lvlstr), end);
+static void _hasdigests_iter(struct dbent *ent, void *uarg) {
+	if (ent->kind == 'u' && ent->ku.digest)
+		*(int *)uarg = 1;
+}
 
-			char *nendptr;
-			uid_t uid = MUST(strtoul(uidstr, &nendptr, 10));
-			if (*nendptr != '\0') {
-				fprintf(stdout, "invalid uid: '%s'\n", uidstr);
+// The instance's key for secret digests, created on first use. A db that
+// already has digests in it was written with a key, and a new one would
+// make every one of them unmatchable, so in that case the key is gone
+// rather than not made yet.
+static unsigned char *digestkey(void) {
+	static unsigned char key[DIGEST_KEYLEN];
+	static int loaded;
+	if (!loaded) {
+		if (!loaddigestkey("dbkey", key, 0)) {
+			int hasdigests = 0;
+			iter_db(_hasdigests_iter, &hasdigests);
+			if (hasdigests) {
+				fputs("dbkey is missing, but the db has digests made with it\n", stderr);
 				exit(1);
 			}
-			unsigned lvl = strtoul(lvlstr, &nendptr, 10);
-			if (*nendptr != '\0') {
-				fprintf(stdout, "invalid lvl: '%s'\n", lvlstr);
-				exit(1);
-			}
-
-			ent.kind = 'c';
-			ent.kc.uid = uid;
-			ent.kc.lvl = lvl;
-		} else {
-			fprintf(stderr, "Unknown db event '%c'\n", evt);
-			exit(1);
+			loaddigestkey("dbkey", key, 1);
 		}
-		(*fn)(&ent, arg);
-		// now cur points to the \n
+		loaded = 1;
+	}
+	return key;
+}
 
-		// increment past the \n, for the next iteration of the loop
-		if (cur <= end && *cur == '\n')
-			cur++;
+// Is trykey the secret of an unlock record? Old records have the secret
+// itself rather than its digest, but we digest it too so that both kinds
+// are compared in constant time.
+static int keymatches(char *secret, char *digest, char *trykey) {
+	char want[DIGEST_HEXLEN + 1], got[DIGEST_HEXLEN + 1];
+	if (!digest) {
+		digestsecret(digestkey(), secret, want);
+		digest = want;
 	}
+	digestsecret(digestkey(), trykey, got);
+	return digesteq(digest, got);
 }
 
 struct _numcnt_iter_arg {
@@ -224,23 +185,29 @@ static int usr_numunlocked(uid_t uid) {
 struct _get_levelent_arg {
 	uid_t uid;
 	unsigned lvl;
-	char *foundkey;
+	struct dbent *found;
+	int nfound;
 };
 static void _get_levelent_iter(struct dbent *ent, void *uarg) {
 	struct _get_levelent_arg *arg = uarg;
 	if (ent->kind == 'u') {
-		if (ent->ku.uid == arg->uid && ent->ku.lvl == arg->lvl)
-			arg->foundkey = ent->ku.secret;
+		if (ent->ku.uid == arg->uid && ent->ku.lvl == arg->lvl) {
+			*arg->found = *ent;
+			arg->nfound++;
+		}
 	}
 }
-static char *get_secret(uid_t uid, unsigned lvl) {
+// Finds uid's unlock record for lvl (the last one, if there are several).
+// Its strings point into g_dbcontent.
+static int get_unlock(uid_t uid, unsigned lvl, struct dbent *found) {
 	struct _get_levelent_arg arg = {
 		.uid = uid,
 		.lvl = lvl,
-		.foundkey = NULL,
+		.found = found,
+		.nfound = 0,
 	};
 	iter_db(_get_levelent_iter, &arg);
-	return arg.foundkey;
+	return arg.nfound != 0;
 }
 
 static int usr_curlevel(uid_t uid) {
@@ -267,19 +234,26 @@ static int usr_numcomplete(uid_t uid) {
 	return arg.n;
 }
 static int usr_won(uid_t uid) {
-	return usr_numcomplete(uid) == ARRAY_LEN(levelimpls);
+	return usr_numcomplete(uid) == g_nlevels;
 }
 
-// returned string is only valid until this function is called again
-static char *usrnameof(uid_t uid) {
-	struct passwd *pwd = getpwuid(uid);
-	if (!pwd)
-		return "<deleted user>";
-	return pwd->pw_name;
-}
-// see usrnameof() above
+// also used as the name of the player's directory
 static char *myname(void) {
-	return usrnameof(g_myuid);
+	static char uidname[32];
+	char *name = lookupname(g_myuid);
+	if (name)
+		return name;
+	// no passwd entry (e.g. a loadgen player), so go by the uid
+	snprintf(uidname, sizeof(uidname), "uid%lu", (unsigned long)g_myuid);
+	return uidname;
+}
+
+static void printts(unsigned long long ts) {
+	time_t secs = ts / 1000;
+	struct tm tm;
+	char buf[64];
+	strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime_r(&secs, &tm));
+	printf("\ttime: %s.%03llu\n", buf, ts % 1000);
 }
 
 static void printent_iter(struct dbent *ent, void *_unused) {
@@ -288,11 +262,12 @@ static void printent_iter(struct dbent *ent, void *_unused) {
 			"unlocked:\n"
 			"\tuid: %lu (%s)\n"
 			"\tlvl: %u\n"
-			"\tsecret: %s\n"
+			"\t%s: %s\n"
 			, (unsigned long)ent->ku.uid
 			, usrnameof(ent->ku.uid)
 			, ent->ku.lvl
-			, ent->ku.secret
+			, ent->ku.digest ? "digest" : "secret"
+			, ent->ku.digest ? ent->ku.digest : ent->ku.secret
 		);
 	} else if (ent->kind == 'c') {
 		printf(
@@ -307,6 +282,8 @@ static void printent_iter(struct dbent *ent, void *_unused) {
 		fprintf(stderr, "Unknown dbent kind '%c'\n", ent->kind);
 		exit(1);
 	}
+	if (ent->ts)
+		printts(ent->ts);
 }
 
 // is the user currently in a level?
@@ -354,16 +331,55 @@ static void activate_level(int playerdir, unsigned lvlno, uid_t playeruid) {
 	newlvl.ku.uid = playeruid;
 	newlvl.ku.lvl = lvlno;
 	int lvlidx = lvlno - 1;
-	if (lvlidx >= ARRAY_LEN(levelimpls)) {
+	if (lvlidx >= g_nlevels) {
 		fprintf(stderr, "Tried to activate out-of-bounds level %u.\n", lvlno);
 		exit(1);
 	}
 	int readmefd = MUST(openat(playerdir, pathbuf, O_CREAT|O_EXCL|O_WRONLY, 0644));
 	int filesdir = openfilesdir(playerdir);
-	newlvl.ku.secret = (*levelimpls[lvlno - 1])(readmefd, filesdir, lvlno);
+	char *secret = (*g_levels[lvlno - 1].impl)(readmefd, filesdir, lvlno);
+	// only the digest goes in the db, so the db doesn't give away answers
+	char digest[DIGEST_HEXLEN + 1];
+	digestsecret(digestkey(), secret, digest);
+	newlvl.ku.secret = NULL;
+	newlvl.ku.digest = digest;
 	insertdb(&newlvl);
 }
 
+/*
+Wrong claims don't go in the db, which everything under the lock reads,
+but in a log of their own, "attempts", as 'a' records in the db format.
+Only `runme stats` reads it. It's appended to after the db lock is
+released, under an fcntl() lock of its own that has no watchdog, so
+however slow the file system is it can't get us killed.
+*/
+static void logattempts(struct dbent *ents, size_t nents) {
+	int fd = MUST(open("attempts", O_CREAT|O_APPEND|O_WRONLY, 0600));
+	struct flock lk = {
+		.l_type = F_WRLCK,
+		.l_whence = SEEK_SET,
+	};
+	MUST(fcntl(fd, F_SETLKW, &lk));
+	// stamped with the lock held, so the log is in order
+	unsigned long long ts = nowms();
+
+	char *buf;
+	size_t buflen;
+	FILE *out = MUST(open_memstream(&buf, &buflen));
+	for (size_t i = 0; i < nents; i++) {
+		ents[i].ts = ts;
+		fmtdbent(out, &ents[i]);
+	}
+	MUST(fclose(out));
+	if (MUST(write(fd, buf, buflen)) != buflen) {
+		fputs("short write to attempts\n", stderr);
+		exit(1);
+	}
+	free(buf);
+	// closing it releases the lock
+	close(fd);
+}
+
 void tryclaim(uid_t puid, char *trycode) {
 	if (!usr_has_inprogress(puid)) {
 		puts("You have nothing to claim right now...");
@@ -371,13 +387,13 @@ void tryclaim(uid_t puid, char *trycode) {
 	}
 
 	unsigned curlvl = usr_curlevel(puid);
-	char *realcode = get_secret(puid, curlvl);
-	if (realcode == NULL) {
+	struct dbent unlock;
+	if (!get_unlock(puid, curlvl, &unlock)) {
 		fputs("secret not in db\n", stderr);
 		exit(1);
 	}
 
-	if (!strcmp(realcode, trycode)) {
+	if (keymatches(unlock.ku.secret, unlock.ku.digest, trycode)) {
 		struct dbent completed;
 		completed.kind = 'c';
 		completed.kc.uid = puid;
@@ -408,41 +424,482 @@ void tryclaim(uid_t puid, char *trycode) {
 			);
 		}
 	} else {
+		// logged so `runme stats` can see how many tries levels take
+		struct dbent attempt;
+		attempt.kind = 'a';
+		attempt.kc.uid = puid;
+		attempt.kc.lvl = curlvl;
+		closedb();
+		logattempts(&attempt, 1);
 		puts("Hmmm, that doesn't look like the correct key.");
 	}
 }
 
-// This timer is to prevent someone from doing a denial-of-service
-// by e.g. suspending us while we're holding the db lock.
-void init_killtimer(void) {
-	timer_t timer;
-	struct sigevent evt = {
-		.sigev_notify = SIGEV_SIGNAL,
-		.sigev_signo = SIGKILL,
-	};
-	MUST(timer_create(CLOCK_REALTIME, &evt, &timer));
-	struct itimerspec spec = {
-		// 100000000ns = 100ms
-		.it_value = (struct timespec) { .tv_nsec = 100000000 }
-	};
-	MUST(timer_settime(timer, 0, &spec, NULL));
+// per-player state, as tryclaim() would see it
+struct usrstate {
+	struct uidtabent hdr;
+	unsigned numunlocked;
+	unsigned numcomplete;
+	// secret or digest of the most recently unlocked level (points into
+	// g_dbcontent)
+	char *cursecret;
+	char *curdigest;
+};
+
+static void _usrindex_iter(struct dbent *ent, void *uarg) {
+	struct uidtab *idx = uarg;
+	uid_t uid = ent->kind == 'u' ? ent->ku.uid : ent->kc.uid;
+	struct usrstate *st = uidtab_get(idx, uid);
+	if (ent->kind == 'u') {
+		st->numunlocked++;
+		// same rule as get_unlock(): the last matching 'u' wins
+		if (ent->ku.lvl == st->numunlocked) {
+			st->cursecret = ent->ku.secret;
+			st->curdigest = ent->ku.digest;
+		}
+	} else if (ent->kind == 'c') {
+		st->numcomplete++;
+	}
 }
 
-int main(int argc, char **argv) {
-	umask(0022);
-	MUST(chdir("/home/" BUILD_USER "/keyhunt"));
-	init_killtimer();
-	opendb();
+// One pass over the db. The table grows with the number of players, which
+// is far smaller than the db, so it's cheaper than sizing it up front.
+static void usrindex_build(struct uidtab *idx) {
+	*idx = (struct uidtab){ .entsize = sizeof(struct usrstate) };
+	iter_db(_usrindex_iter, idx);
+}
 
-	// database dump
-	if (argc == 2 && !strcmp(argv[1], "db") && geteuid() == getuid()) {
-		iter_db(printent_iter, NULL);
+struct submission {
+	uid_t uid;
+	char *key;
+	// the line as given, for error messages
+	char *line;
+	int valid;
+	// the verdict, and the level it's for (0 if none)
+	char *result;
+	unsigned lvl;
+};
+
+static void read_submissions(FILE *in, struct submission **subs, size_t *nsubs) {
+	size_t cap = 0;
+	*subs = NULL;
+	*nsubs = 0;
+
+	char *line = NULL;
+	size_t linecap = 0;
+	ssize_t len;
+	while ((len = getline(&line, &linecap, in)) != -1) {
+		// trim trailing whitespace, same as a piped-in claim
+		while (len > 0 && (line[len-1] == '\n' || line[len-1] == ' ' || line[len-1] == '\t'))
+			line[--len] = '\0';
+		if (len == 0)
+			continue;
+
+		if (*nsubs == cap) {
+			cap = cap ? cap * 2 : 256;
+			*subs = MUST(realloc(*subs, cap * sizeof(**subs)));
+		}
+		struct submission *sub = &(*subs)[(*nsubs)++];
+		sub->line = MUST(strdup(line));
+		sub->valid = 0;
+
+		char *usr = strtok(line, " \t");
+		char *key = strtok(NULL, " \t");
+		if (!usr || !key || strtok(NULL, " \t"))
+			continue;
+		char *nendptr;
+		unsigned long uid = strtoul(usr, &nendptr, 10);
+		if (*nendptr != '\0') {
+			// not a number; allow usernames too
+			struct passwd *pwd = getpwnam(usr);
+			if (!pwd)
+				continue;
+			uid = pwd->pw_uid;
+		}
+		sub->uid = uid;
+		sub->key = MUST(strdup(key));
+		sub->valid = 1;
+	}
+	free(line);
+}
+
+// Grades a batch of "UID KEY" lines against an index of the db that is
+// built once, instead of rescanning the db for every submission like
+// tryclaim() does. Prints "UID<TAB>LVL<TAB>RESULT" per submission. With
+// record set, correct submissions are recorded as completed (in one
+// append) and wrong ones are logged like tryclaim() logs them; the
+// player's next level is started the next time they run the game.
+// Nothing is printed until the lock is released, so a slow reader can't
+// get us killed by the lock watchdog.
+static void gradebatch(FILE *in, int record) {
+	struct submission *subs;
+	size_t nsubs;
+	// read everything before taking the lock, input may be slow
+	read_submissions(in, &subs, &nsubs);
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	struct uidtab idx;
+	usrindex_build(&idx);
+
+	struct dbent *completions = MUST(calloc(nsubs ? nsubs : 1, sizeof(*completions)));
+	size_t ncompletions = 0;
+	struct dbent *attempts = MUST(calloc(nsubs ? nsubs : 1, sizeof(*attempts)));
+	size_t nattempts = 0;
+	size_t ncorrect = 0;
+	for (size_t i = 0; i < nsubs; i++) {
+		struct submission *sub = &subs[i];
+		sub->lvl = 0;
+		if (!sub->valid) {
+			sub->result = "bad-input";
+			continue;
+		}
+		struct usrstate *st = uidtab_find(&idx, sub->uid);
+		if (!st || st->numcomplete == st->numunlocked) {
+			sub->result = "nothing-to-claim";
+			continue;
+		}
+		if (st->cursecret == NULL && st->curdigest == NULL) {
+			fputs("secret not in db\n", stderr);
+			exit(1);
+		}
+		sub->lvl = st->numunlocked;
+		if (!keymatches(st->cursecret, st->curdigest, sub->key)) {
+			sub->result = "wrong";
+			if (record) {
+				struct dbent *ent = &attempts[nattempts++];
+				ent->kind = 'a';
+				ent->kc.uid = sub->uid;
+				ent->kc.lvl = st->numunlocked;
+			}
+			continue;
+		}
+
+		sub->result = "correct";
+		ncorrect++;
+		if (record) {
+			struct dbent *ent = &completions[ncompletions++];
+			ent->kind = 'c';
+			ent->kc.uid = sub->uid;
+			ent->kc.lvl = st->numunlocked;
+			// later submissions for the same player see the level as done
+			st->numcomplete++;
+		}
+	}
+	if (ncompletions)
+		insertdb_many(completions, ncompletions);
+	closedb();
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (nattempts)
+		logattempts(attempts, nattempts);
+
+	for (size_t i = 0; i < nsubs; i++) {
+		struct submission *sub = &subs[i];
+		if (!sub->valid)
+			printf("-\t-\t%s: %s\n", sub->result, sub->line);
+		else if (sub->lvl == 0)
+			printf("%lu\t-\t%s\n", (unsigned long)sub->uid, sub->result);
+		else
+			printf("%lu\t%u\t%s\n", (unsigned long)sub->uid, sub->lvl, sub->result);
+	}
+	fprintf(stderr, "graded %zu submissions (%zu correct, %zu recorded) in %.3f ms\n",
+		nsubs, ncorrect, ncompletions,
+		(end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6);
+
+	free(completions);
+	free(attempts);
+	uidtab_free(&idx);
+	for (size_t i = 0; i < nsubs; i++) {
+		free(subs[i].line);
+		if (subs[i].valid)
+			free(subs[i].key);
+	}
+	free(subs);
+}
+
+// Prints the db from offset onwards (which must be the start of a record),
+// and then every record that gets appended to it, as it is appended. Like
+// export, this reads the db without the lock: the db is only appended to,
+// and a record that is still being written is held back until it's done.
+static void followdb(off_t offset) {
+#define FOLLOWCHUNK (1 << 20)
+	// created like opendb() would, so this can be started before anyone
+	// has played
+	int fd = MUST(open("db", O_CREAT|O_RDONLY, 0600));
+	struct stat st;
+	MUST(fstat(fd, &st));
+	if (offset > st.st_size) {
+		fprintf(stderr, "offset %lld is past the end of the db (%lld bytes)\n",
+			(long long)offset, (long long)st.st_size);
+		exit(1);
+	}
+	// watch before the first read, so nothing appended in between is missed
+	int inotifyfd = MUST(inotify_init1(0));
+	MUST(inotify_add_watch(inotifyfd, "db", IN_MODIFY|IN_DELETE_SELF|IN_MOVE_SELF));
+
+	// holds a partially-written record between reads
+	char *buf = MUST(malloc(FOLLOWCHUNK * 2));
+	size_t buflen = 0;
+	size_t bufcap = FOLLOWCHUNK * 2;
+	int caughtup = 0;
+	// If the offset lands in the middle of a record, skip to the next one.
+	// Fields never contain '\n', so the first one found ends that record.
+	char prev = '\n';
+	int midrecord = offset > 0 && MUST(pread(fd, &prev, 1, offset - 1)) == 1 && prev != '\n';
+	for (;;) {
+		MUST(fstat(fd, &st));
+		if (st.st_size < offset) {
+			fputs("db was truncated, starting over from the beginning\n", stderr);
+			offset = 0;
+			buflen = 0;
+			midrecord = 0;
+		}
+		while (offset < st.st_size) {
+			if (bufcap - buflen < FOLLOWCHUNK) {
+				bufcap *= 2;
+				buf = MUST(realloc(buf, bufcap));
+			}
+			ssize_t nread = MUST(pread(fd, buf + buflen, FOLLOWCHUNK, offset));
+			if (nread == 0)
+				break;
+			offset += nread;
+			buflen += nread;
+			if (midrecord) {
+				char *nl = memchr(buf, '\n', buflen);
+				size_t skip = nl ? nl + 1 - buf : buflen;
+				memmove(buf, buf + skip, buflen - skip);
+				buflen -= skip;
+				midrecord = !nl;
+			}
+			size_t used = parsedb(buf, buflen, printent_iter, NULL);
+			memmove(buf, buf + used, buflen - used);
+			buflen -= used;
+		}
+		fflush(stdout);
+		if (!caughtup) {
+			namecache_save("namecache");
+			caughtup = 1;
+		}
+
+		// Block until the db changes. We don't care what the events are
+		// beyond whether the db went away; every wakeup just reads the tail.
+		char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+		ssize_t nevents = MUST(read(inotifyfd, events, sizeof(events)));
+		for (char *p = events; p < events + nevents; ) {
+			struct inotify_event *evt = (struct inotify_event *)p;
+			if (evt->mask & (IN_DELETE_SELF|IN_MOVE_SELF|IN_IGNORED)) {
+				fputs("db was removed or replaced\n", stderr);
+				exit(1);
+			}
+			p += sizeof(*evt) + evt->len;
+		}
+	}
+#undef FOLLOWCHUNK
+}
+
+// Runs the reference solver on a player's directory (one that has a
+// README.lvl-N and a files/ directory), and reports how fast it was.
+static int solvedir(char *path) {
+	int dirfd = MUST(open(path, O_DIRECTORY));
+	DIR *dir = MUST(fdopendir(MUST(dup(dirfd))));
+	struct dirent *i;
+	unsigned lvlno = 0;
+	while ((i = MUST(readdir(dir))) != NULL) {
+		unsigned n;
+		if (sscanf(i->d_name, "README.lvl-%u", &n) == 1 && n > lvlno)
+			lvlno = n;
+	}
+	MUST(closedir(dir));
+	if (lvlno == 0 || lvlno > g_nlevels) {
+		fprintf(stderr, "No level README in %s\n", path);
+		return 1;
+	}
+
+	char readmepath[100];
+	snprintf(readmepath, sizeof(readmepath), "README.lvl-%u", lvlno);
+	int readmefd = MUST(openat(dirfd, readmepath, O_RDONLY));
+	char readme[4096];
+	ssize_t nread = MUST(read(readmefd, readme, sizeof(readme) - 1));
+	readme[nread] = '\0';
+	close(readmefd);
+	int filesdir = MUST(openat(dirfd, "files", O_DIRECTORY));
+
+	const struct level *lvl = &g_levels[lvlno - 1];
+	struct solvestats stats = { 0 };
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	char *key = solvelevel(lvl->impl, filesdir, readme, &stats);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	fprintf(stderr, "level %u (%s): %llu bytes, %llu files in %.3f ms",
+		lvlno, lvl->name, stats.bytes, stats.files, secs * 1e3);
+	if (stats.bytes)
+		fprintf(stderr, ", %.1f MB/s", stats.bytes / secs / 1e6);
+	if (stats.files)
+		fprintf(stderr, ", %.0f files/s", stats.files / secs);
+	fputc('\n', stderr);
+	if (!key) {
+		fputs("No single answer found\n", stderr);
+		return 1;
+	}
+	puts(key);
+	free(key);
+	return 0;
+}
+
+static void usage(void) {
+	puts(
+		"usage:\n"
+		"    runme                  start or continue the game\n"
+		"    runme claim [KEY]      claim a secret key (or pipe it in)\n"
+		"    runme help             show this message\n"
+		"admin:\n"
+		"    runme db [--follow [--offset N]]\n"
+		"                           dump the db; with --follow, keep printing new\n"
+		"                           records (from byte N of the db) as they arrive\n"
+		"    runme grade [--record] [FILE]\n"
+		"                           grade \"UID KEY\" lines from FILE or stdin\n"
+		"    runme export [--csv|--jsonl] [--uid N[-M]] [--lvl N[-M]] [--kind u|c]\n"
+		"                           stream the db as CSV or JSON Lines\n"
+		"    runme solve [DIR]      solve the level in a player's directory\n"
+		"    runme stats            solve times, tries and arrival times, by level"
+	);
+}
+
+// parses the digits in [str, end) into *n, which must be at most limit;
+// there must be at least one digit
+static int parsedigits(char *str, char *end, unsigned long limit, unsigned long *n) {
+	if (str == end || strspn(str, "0123456789") != end - str)
 		return 0;
+	char *nendptr;
+	errno = 0;
+	*n = strtoul(str, &nendptr, 10);
+	return errno == 0 && nendptr == end && *n <= limit;
+}
+
+// Parses "N", "N-M", "N-" or "-M" into an inclusive range within
+// [0, limit]; a missing end is 0 or limit. An empty or backwards range,
+// or a number past limit, is an error rather than a range that matches
+// nothing (or something else).
+static int parserange(char *str, unsigned long limit, unsigned long *min, unsigned long *max) {
+	char *dash = strchr(str, '-');
+	char *end = str + strlen(str);
+	*min = 0;
+	*max = limit;
+	if (!dash) {
+		if (!parsedigits(str, end, limit, min))
+			return 0;
+		*max = *min;
+		return 1;
 	}
+	if (dash == str && dash + 1 == end)
+		return 0;
+	if (dash != str && !parsedigits(str, dash, limit, min))
+		return 0;
+	if (dash + 1 != end && !parsedigits(dash + 1, end, limit, max))
+		return 0;
+	return *min <= *max;
+}
+
+int main(int argc, char **argv) {
+	umask(0022);
 
+	// Argument checking comes first, and must not touch the db, the
+	// lock or NSS, so that mistakes fail fast even when the game is busy.
+	int isadmin = geteuid() == getuid();
+	int isdump = isadmin && argc >= 2 && !strcmp(argv[1], "db");
+	int isgrade = isadmin && argc >= 2 && !strcmp(argv[1], "grade");
+	int isexport = isadmin && argc >= 2 && !strcmp(argv[1], "export");
+	int isstats = isadmin && argc == 2 && !strcmp(argv[1], "stats");
+	if (isadmin && argc >= 2 && !strcmp(argv[1], "solve")) {
+		if (argc > 3) {
+			puts("Too many arguments");
+			return 1;
+		}
+		// doesn't need an instance at all, just the player's files
+		return solvedir(argc == 3 ? argv[2] : ".");
+	}
 	int isclaim = 0;
 	char *claimcode;
-	if (argc > 1) {
+	if (argc == 2 && !strcmp(argv[1], "help")) {
+		usage();
+		return 0;
+	}
+	FILE *gradein = stdin;
+	int graderecord = 0;
+	if (isgrade) {
+		int argi = 2;
+		if (argi < argc && !strcmp(argv[argi], "--record")) {
+			graderecord = 1;
+			argi++;
+		}
+		if (argc - argi > 1) {
+			puts("Too many arguments");
+			return 1;
+		}
+		// opened before chdir() so relative paths work
+		if (argi < argc)
+			gradein = MUST(fopen(argv[argi], "r"));
+	}
+	int follow = 0;
+	off_t followoffset = 0;
+	if (isdump) {
+		for (int argi = 2; argi < argc; argi++) {
+			char *nendptr;
+			if (!strcmp(argv[argi], "--follow")) {
+				follow = 1;
+			} else if (!strcmp(argv[argi], "--offset") && argi + 1 < argc) {
+				followoffset = strtoull(argv[++argi], &nendptr, 10);
+				if (*nendptr != '\0') {
+					usage();
+					return 1;
+				}
+			} else {
+				usage();
+				return 1;
+			}
+		}
+		if (followoffset && !follow) {
+			usage();
+			return 1;
+		}
+	}
+	enum exportfmt exportfmt = EXPORT_CSV;
+	struct exportfilter exportfilter = {
+		.uidmin = 0,
+		.uidmax = (uid_t)-1,
+		.lvlmin = 0,
+		.lvlmax = -1,
+		.kinds = "uc",
+	};
+	if (isexport) {
+		for (int argi = 2; argi < argc; argi++) {
+			char *opt = argv[argi];
+			char *val = argi + 1 < argc ? argv[argi + 1] : NULL;
+			unsigned long min, max;
+			if (!strcmp(opt, "--csv")) {
+				exportfmt = EXPORT_CSV;
+			} else if (!strcmp(opt, "--jsonl")) {
+				exportfmt = EXPORT_JSONL;
+			} else if (!strcmp(opt, "--uid") && val && parserange(val, (uid_t)-1, &min, &max)) {
+				exportfilter.uidmin = min;
+				exportfilter.uidmax = max;
+				argi++;
+			} else if (!strcmp(opt, "--lvl") && val && parserange(val, (unsigned)-1, &min, &max)) {
+				exportfilter.lvlmin = min;
+				exportfilter.lvlmax = max;
+				argi++;
+			} else if (!strcmp(opt, "--kind") && val && *val && strspn(val, "uc") == strlen(val)) {
+				exportfilter.kinds = val;
+				argi++;
+			} else {
+				usage();
+				return 1;
+			}
+		}
+	} else if (argc > 1 && !isdump && !isgrade && !isstats) {
 		if (argc > 3) {
 			puts("Too many arguments");
 			return 1;
@@ -486,11 +943,68 @@ int main(int argc, char **argv) {
 		exit(1);
 	}
 
+	// Knobs only honored when we aren't running with someone else's
+	// privileges: KEYHUNT_INSTANCE lets an admin pick an instance by name,
+	// and the rest let loadgen point the real binary at a scratch instance
+	// and play as many different (fake) users.
+	char *instname = NULL;
+	char *rootdir = NULL;
+	g_myuid = getuid();
+	if (isadmin) {
+		instname = getenv("KEYHUNT_INSTANCE");
+		rootdir = getenv("KEYHUNT_ROOT");
+		if (getenv("KEYHUNT_UID"))
+			g_myuid = strtoul(getenv("KEYHUNT_UID"), NULL, 10);
+		g_lockstats = getenv("KEYHUNT_LOCKSTATS") != NULL;
+	}
+	if (!rootdir)
+		rootdir = findinstance(KEYHUNT_CONF, instname, "/home/" BUILD_USER "/keyhunt");
+	if (!rootdir) {
+		if (instname)
+			fprintf(stderr, "No instance named '%s' in " KEYHUNT_CONF "\n", instname);
+		else
+			puts("You aren't in any of the groups that keyhunt is set up for.");
+		return 1;
+	}
+	MUST(chdir(rootdir));
+	// everything we create in here is created as the owner of the binary
+	struct stat rootst;
+	MUST(stat(".", &rootst));
+	if (rootst.st_uid != geteuid()) {
+		fprintf(stderr, "%s is not owned by the owner of runme\n", rootdir);
+		return 1;
+	}
+
+	// database dump
+	if (isdump) {
+		namecache_load("namecache");
+		if (follow)
+			followdb(followoffset); // doesn't return
+		iter_db(printent_iter, NULL);
+		namecache_save("namecache");
+		return 0;
+	}
+
+	if (isgrade) {
+		gradebatch(gradein, graderecord);
+		return 0;
+	}
+
+	if (isexport) {
+		namecache_load("namecache");
+		exportdb("db", exportfmt, &exportfilter);
+		namecache_save("namecache");
+		return 0;
+	}
+
+	if (isstats) {
+		dbstats("db", "attempts");
+		return 0;
+	}
+
 	mkdir("play", 0755);
 	int gamedirfd = MUST(open("play", O_DIRECTORY));
 
-	g_myuid = getuid();
-
 	mkdirat(gamedirfd, myname(), 0755);
 	g_playerdir = MUST(openat(gamedirfd, myname(), O_DIRECTORY));
 
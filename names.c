@@ -0,0 +1,133 @@
+#include <fcntl.h>
+#include <pwd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "names.h"
+#include "uidtab.h"
+#include "util.h"
+
+// entries in the on-disk cache older than this are re-resolved
+#define NAMECACHE_MAXAGE (60*60*24)
+#define DELETED_USER "<deleted user>"
+
+struct nameent {
+	struct uidtabent hdr;
+	// NULL for a uid that has no passwd entry
+	char *name;
+};
+
+static struct uidtab g_names = { .entsize = sizeof(struct nameent) };
+// set when a lookup added something that isn't in the on-disk cache yet
+static int g_namesdirty;
+// mtime of the on-disk cache we loaded, if any
+static struct timespec g_loadedmtime;
+
+static struct nameent *addname(uid_t uid, char *name) {
+	struct nameent *ent = uidtab_add(&g_names, uid);
+	ent->name = name ? MUST(strdup(name)) : NULL;
+	return ent;
+}
+
+char *lookupname(uid_t uid) {
+	struct nameent *ent = uidtab_find(&g_names, uid);
+	if (!ent) {
+		struct passwd *pwd = getpwuid(uid);
+		ent = addname(uid, pwd ? pwd->pw_name : NULL);
+		g_namesdirty = 1;
+	}
+	return ent->name;
+}
+
+char *usrnameof(uid_t uid) {
+	char *name = lookupname(uid);
+	return name ? name : DELETED_USER;
+}
+
+/*
+namecache format (each line):
+
+	UID\000NAME\000\n
+
+NAME is empty for a uid that has no passwd entry.
+*/
+void namecache_load(char *path) {
+	FILE *f = fopen(path, "r");
+	if (!f)
+		return;
+	struct stat st;
+	MUST(fstat(fileno(f), &st));
+	if (time(NULL) - st.st_mtime > NAMECACHE_MAXAGE) {
+		fclose(f);
+		return;
+	}
+	g_loadedmtime = st.st_mtim;
+
+	char *line = NULL;
+	size_t linecap = 0;
+	ssize_t len;
+	while ((len = getline(&line, &linecap, f)) > 0) {
+		char *uidstr = line;
+		size_t uidlen = strnlen(uidstr, len);
+		if (uidlen + 1 >= len)
+			break;
+		char *name = uidstr + uidlen + 1;
+		if (strnlen(name, len - uidlen - 1) + 2 != len - uidlen - 1)
+			break;
+
+		char *nendptr;
+		uid_t uid = strtoul(uidstr, &nendptr, 10);
+		if (*nendptr != '\0')
+			break;
+		if (!uidtab_find(&g_names, uid))
+			addname(uid, *name ? name : NULL);
+	}
+	free(line);
+	fclose(f);
+}
+
+void namecache_save(char *path) {
+	if (!g_namesdirty)
+		return;
+
+	char tmppath[256];
+	int nwritten = snprintf(tmppath, sizeof(tmppath), "%s.tmp", path);
+	if (nwritten >= sizeof(tmppath)) {
+		fputs("tmppath overflow :(\n", stderr);
+		exit(1);
+	}
+	// the cache is only an optimization, so failing to write it isn't fatal
+	int fd = open(tmppath, O_CREAT|O_TRUNC|O_WRONLY, 0600);
+	if (fd == -1)
+		return;
+	FILE *f = MUST(fdopen(fd, "w"));
+	for (size_t i = 0; i < g_names.cap; i++) {
+		struct nameent *ent = uidtab_at(&g_names, i);
+		if (ent) {
+			fprintf(f, "%lu", (unsigned long)ent->hdr.uid);
+			fputc('\0', f);
+			if (ent->name)
+				fputs(ent->name, f);
+			fputc('\0', f);
+			fputc('\n', f);
+		}
+	}
+	if (fclose(f) != 0 || rename(tmppath, path) != 0) {
+		unlink(tmppath);
+		return;
+	}
+	g_namesdirty = 0;
+	// The file's age is the age of its oldest entries, so that they
+	// still expire even if the file keeps being rewritten.
+	if (g_loadedmtime.tv_sec) {
+		struct timespec times[2] = {
+			{ .tv_nsec = UTIME_OMIT },
+			g_loadedmtime,
+		};
+		utimensat(AT_FDCWD, path, times, 0);
+	}
+}
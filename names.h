@@ -0,0 +1,18 @@
+#ifndef __HAVE_NAMES_H
+#define __HAVE_NAMES_H
+
+#include <sys/types.h>
+
+// uid -> username, memoized for the life of the process so that each
+// uid costs at most one getpwuid() (which can be slow on networked NSS).
+// The returned string stays valid until the process exits.
+char *usrnameof(uid_t uid);
+// same as usrnameof(), but NULL for a uid with no passwd entry
+char *lookupname(uid_t uid);
+
+// Optional on-disk copy of the cache. Loading a missing or stale file is
+// a no-op; saving only rewrites the file if new names were looked up.
+void namecache_load(char *path);
+void namecache_save(char *path);
+
+#endif
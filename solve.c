@@ -0,0 +1,279 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "levels.h"
+#include "solve.h"
+#include "util.h"
+
+// a file mapped into memory
+struct mapped {
+	char *buf;
+	size_t len;
+};
+
+static int mapfile(int dirfd, char *name, struct mapped *m, struct solvestats *stats) {
+	int fd = openat(dirfd, name, O_RDONLY);
+	if (fd == -1)
+		return 0;
+	struct stat st;
+	MUST(fstat(fd, &st));
+	m->len = st.st_size;
+	m->buf = NULL;
+	if (m->len != 0) {
+		m->buf = MUST(mmap(NULL, m->len, PROT_READ, MAP_PRIVATE|MAP_POPULATE, fd, 0));
+		madvise(m->buf, m->len, MADV_SEQUENTIAL);
+	}
+	close(fd);
+	stats->bytes += m->len;
+	return 1;
+}
+
+static void unmapfile(struct mapped *m) {
+	if (m->buf)
+		munmap(m->buf, m->len);
+}
+
+// Returns the first '\n' in [p, end), or end. 16 bytes at a time where
+// we have SSE2; the lines in these levels are mostly 10-250 bytes.
+static char *findnl(char *p, char *end) {
+#ifdef __SSE2__
+	__m128i nl = _mm_set1_epi8('\n');
+	while (end - p >= 16) {
+		__m128i chunk = _mm_loadu_si128((__m128i *)p);
+		int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, nl));
+		if (mask)
+			return p + __builtin_ctz(mask);
+		p += 16;
+	}
+#endif
+	char *nl1 = memchr(p, '\n', end - p);
+	return nl1 ? nl1 : end;
+}
+
+static char *dupline(char *s, size_t len) {
+	char *out = MUST(malloc(len + 1));
+	memcpy(out, s, len);
+	out[len] = '\0';
+	return out;
+}
+
+// the first number in the README, e.g. a length the player is told about
+static unsigned readmenum(char *readme) {
+	char *p = strpbrk(readme, "0123456789");
+	return p ? strtoul(p, NULL, 10) : 0;
+}
+
+// Calls pred for every line of files/lines, and returns the only line
+// it accepted (NULL if that isn't exactly one).
+static char *onlyline(int filesdir, int (*pred)(char *, size_t, void *), void *arg,
+		struct solvestats *stats) {
+	struct mapped m;
+	if (!mapfile(filesdir, "lines", &m, stats))
+		return NULL;
+	char *found = NULL;
+	size_t foundlen = 0;
+	unsigned nfound = 0;
+	char *end = m.buf + m.len;
+	for (char *line = m.buf; line < end; ) {
+		char *nl = findnl(line, end);
+		if ((*pred)(line, nl - line, arg)) {
+			nfound++;
+			found = line;
+			foundlen = nl - line;
+		}
+		line = nl + 1;
+	}
+	char *key = nfound == 1 ? dupline(found, foundlen) : NULL;
+	unmapfile(&m);
+	return key;
+}
+
+static char *solve_onboarding(int filesdir, char *readme, struct solvestats *stats) {
+	struct mapped m;
+	if (!mapfile(filesdir, "secret", &m, stats))
+		return NULL;
+	char *key = dupline(m.buf, findnl(m.buf, m.buf + m.len) - m.buf);
+	unmapfile(&m);
+	return key;
+}
+
+static int _isdigits(char *line, size_t len, void *unused) {
+	if (len == 0)
+		return 0;
+	for (size_t i = 0; i < len; i++) {
+		if ((unsigned)(line[i] - '0') > 9)
+			return 0;
+	}
+	return 1;
+}
+static char *solve_digitline(int filesdir, char *readme, struct solvestats *stats) {
+	return onlyline(filesdir, _isdigits, NULL, stats);
+}
+
+static int _haslen(char *line, size_t len, void *arg) {
+	return len == *(size_t *)arg;
+}
+static char *solve_fixedkeylinelen(int filesdir, char *readme, struct solvestats *stats) {
+	size_t want = readmenum(readme);
+	return onlyline(filesdir, _haslen, &want, stats);
+}
+
+static int _iseven(char *line, size_t len, void *unused) {
+	return len % 2 == 0;
+}
+static char *solve_evenline(int filesdir, char *readme, struct solvestats *stats) {
+	return onlyline(filesdir, _iseven, NULL, stats);
+}
+
+static char *solve_longestline(int filesdir, char *readme, struct solvestats *stats) {
+	struct mapped m;
+	if (!mapfile(filesdir, "lines", &m, stats))
+		return NULL;
+	char *longest = NULL;
+	size_t longestlen = 0;
+	unsigned ntied = 0;
+	char *end = m.buf + m.len;
+	for (char *line = m.buf; line < end; ) {
+		char *nl = findnl(line, end);
+		if (nl - line > longestlen) {
+			longest = line;
+			longestlen = nl - line;
+			ntied = 1;
+		} else if (nl - line == longestlen) {
+			ntied++;
+		}
+		line = nl + 1;
+	}
+	char *key = ntied == 1 ? dupline(longest, longestlen) : NULL;
+	unmapfile(&m);
+	return key;
+}
+
+static char *solve_concatposns(int filesdir, char *readme, struct solvestats *stats) {
+	struct mapped m;
+	if (!mapfile(filesdir, "lines", &m, stats))
+		return NULL;
+	// all lines have the same length, so no need to look for the others
+	size_t nlines = readmenum(readme);
+	size_t linelen = findnl(m.buf, m.buf + m.len) - m.buf + 1;
+	char *key = NULL;
+	if (nlines != 0 && linelen > nlines && linelen * nlines == m.len) {
+		key = MUST(malloc(nlines + 1));
+		for (size_t i = 0; i < nlines; i++)
+			key[i] = m.buf[i * linelen + i];
+		key[nlines] = '\0';
+	}
+	unmapfile(&m);
+	return key;
+}
+
+struct linux_dirent64 {
+	ino64_t d_ino;
+	off64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+// Calls fn for every regular file in dirfd, reading the directory with
+// as few getdents64() calls as possible.
+static void forfiles(int dirfd, void (*fn)(int, char *, void *), void *arg,
+		struct solvestats *stats) {
+	// getdents64 reads from the fd's position, which we don't want to move
+	int fd = MUST(openat(dirfd, ".", O_RDONLY|O_DIRECTORY));
+	static char buf[1 << 16] __attribute__((aligned(8)));
+	long nread;
+	while ((nread = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0) {
+		for (long off = 0; off < nread; ) {
+			struct linux_dirent64 *ent = (struct linux_dirent64 *)(buf + off);
+			off += ent->d_reclen;
+			if (ent->d_type != DT_REG && ent->d_type != DT_UNKNOWN)
+				continue;
+			stats->files++;
+			(*fn)(dirfd, ent->d_name, arg);
+		}
+	}
+	if (nread == -1) {
+		perror("getdents64");
+		exit(1);
+	}
+	close(fd);
+}
+
+struct _newest_arg {
+	struct statx_timestamp newest;
+	char name[256];
+	unsigned ntied;
+};
+static void _newest_iter(int dirfd, char *name, void *uarg) {
+	struct _newest_arg *arg = uarg;
+	struct statx stx;
+	if (statx(dirfd, name, AT_SYMLINK_NOFOLLOW, STATX_MTIME, &stx) == -1)
+		return;
+	struct statx_timestamp t = stx.stx_mtime;
+	if (t.tv_sec > arg->newest.tv_sec
+		|| (t.tv_sec == arg->newest.tv_sec && t.tv_nsec > arg->newest.tv_nsec)) {
+		arg->newest = t;
+		snprintf(arg->name, sizeof(arg->name), "%s", name);
+		arg->ntied = 1;
+	} else if (t.tv_sec == arg->newest.tv_sec && t.tv_nsec == arg->newest.tv_nsec) {
+		arg->ntied++;
+	}
+}
+static char *solve_mostrecentfile(int filesdir, char *readme, struct solvestats *stats) {
+	struct _newest_arg arg = { .ntied = 0 };
+	forfiles(filesdir, _newest_iter, &arg, stats);
+	return arg.ntied == 1 ? MUST(strdup(arg.name)) : NULL;
+}
+
+struct _suffix_arg {
+	char name[256];
+	unsigned nfound;
+};
+static void _suffix_iter(int dirfd, char *name, void *uarg) {
+	struct _suffix_arg *arg = uarg;
+	size_t len = strlen(name);
+	if (len >= 3 && !memcmp(name + len - 3, "abc", 3)) {
+		snprintf(arg->name, sizeof(arg->name), "%s", name);
+		arg->nfound++;
+	}
+}
+static char *solve_filenamesuffix(int filesdir, char *readme, struct solvestats *stats) {
+	struct _suffix_arg arg = { .nfound = 0 };
+	forfiles(filesdir, _suffix_iter, &arg, stats);
+	return arg.nfound == 1 ? MUST(strdup(arg.name)) : NULL;
+}
+
+// looked up by impl, so the order doesn't matter
+static struct {
+	lvl_impl_t impl;
+	char *(*solve)(int filesdir, char *readme, struct solvestats *stats);
+} solvers[] = {
+	{ lvlimpl_onboarding, solve_onboarding },
+	{ lvlimpl_digitline, solve_digitline },
+	{ lvlimpl_filenamesuffix, solve_filenamesuffix },
+	{ lvlimpl_fixedkeylinelen, solve_fixedkeylinelen },
+	{ lvlimpl_longestline, solve_longestline },
+	{ lvlimpl_evenline, solve_evenline },
+	{ lvlimpl_mostrecentfile, solve_mostrecentfile },
+	{ lvlimpl_concatposns, solve_concatposns },
+};
+
+char *solvelevel(lvl_impl_t impl, int filesdir, char *readme, struct solvestats *stats) {
+	for (int i = 0; i < ARRAY_LEN(solvers); i++) {
+		if (solvers[i].impl == impl)
+			return (*solvers[i].solve)(filesdir, readme, stats);
+	}
+	return NULL;
+}
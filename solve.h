@@ -0,0 +1,18 @@
+#ifndef __HAVE_SOLVE_H
+#define __HAVE_SOLVE_H
+
+#include "levels.h"
+
+struct solvestats {
+	// bytes of file contents looked at
+	unsigned long long bytes;
+	// directory entries looked at
+	unsigned long long files;
+};
+
+// Reference solver for the level generated by impl: finds the secret key
+// in filesdir, using the level's README text for any parameters. Returns
+// the key (malloc'd), or NULL if the instance has no single answer.
+char *solvelevel(lvl_impl_t impl, int filesdir, char *readme, struct solvestats *stats);
+
+#endif
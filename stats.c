@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "db.h"
+#include "stats.h"
+#include "uidtab.h"
+#include "util.h"
+
+// Solve times go in log2 buckets: bucket 0 is under 1 s, and bucket i is
+// [2^(i-1), 2^i) s.
+#define NBUCKETS 32
+// records for levels past this are assumed to be garbage
+#define MAXLVL 1024
+#define BARWIDTH 40
+
+struct lvlstats {
+	unsigned long unlocks;
+	unsigned long solves;
+	unsigned long wrong;
+	unsigned long buckets[NBUCKETS];
+	// solve times in ms, for the percentiles
+	unsigned long long *times;
+	size_t ntimes;
+	size_t timescap;
+};
+
+// the level a player is on, to match completions up with their unlock
+struct plrent {
+	struct uidtabent hdr;
+	unsigned lvl;
+	unsigned long long unlockts;
+};
+
+// busiest period of some length; periods must come in order
+struct peak {
+	unsigned long long cur;
+	unsigned long ncur;
+	unsigned long long at;
+	unsigned long max;
+};
+
+struct _stats_iter_arg {
+	struct lvlstats *lvls;
+	// highest level seen
+	unsigned nlvls;
+
+	// of struct plrent
+	struct uidtab plrs;
+
+	unsigned long nrecords;
+	unsigned long nwrong;
+	unsigned long ntimed;
+	// Times of all claims, right or wrong. They come from two files, so
+	// they're sorted before looking for the busiest periods.
+	unsigned long long *claimts;
+	size_t nclaims;
+	size_t claimscap;
+	unsigned long long firstts;
+	unsigned long long lastts;
+	// for turning timestamps into local hours of the day
+	long gmtoff;
+	unsigned long hourunlocks[24];
+	unsigned long hourclaims[24];
+	unsigned long hourwrong[24];
+	struct peak peakhour;
+	struct peak peakminute;
+};
+
+static struct lvlstats *getlvl(struct _stats_iter_arg *arg, unsigned lvl) {
+	if (lvl > arg->nlvls) {
+		arg->lvls = MUST(realloc(arg->lvls, lvl * sizeof(*arg->lvls)));
+		memset(arg->lvls + arg->nlvls, 0, (lvl - arg->nlvls) * sizeof(*arg->lvls));
+		arg->nlvls = lvl;
+	}
+	return &arg->lvls[lvl - 1];
+}
+
+static void addsolvetime(struct lvlstats *l, unsigned long long ms) {
+	int bucket = 0;
+	for (unsigned long long secs = ms / 1000; secs && bucket < NBUCKETS - 1; secs >>= 1)
+		bucket++;
+	l->buckets[bucket]++;
+	if (l->ntimes == l->timescap) {
+		l->timescap = l->timescap ? l->timescap * 2 : 64;
+		l->times = MUST(realloc(l->times, l->timescap * sizeof(*l->times)));
+	}
+	l->times[l->ntimes++] = ms;
+}
+
+static void bumppeak(struct peak *pk, unsigned long long period) {
+	if (period != pk->cur) {
+		pk->cur = period;
+		pk->ncur = 0;
+	}
+	if (++pk->ncur > pk->max) {
+		pk->max = pk->ncur;
+		pk->at = period;
+	}
+}
+
+static void _stats_iter(struct dbent *ent, void *uarg) {
+	struct _stats_iter_arg *arg = uarg;
+	uid_t uid = ent->kind == 'u' ? ent->ku.uid : ent->kc.uid;
+	unsigned lvl = ent->kind == 'u' ? ent->ku.lvl : ent->kc.lvl;
+	arg->nrecords++;
+	if (lvl == 0 || lvl > MAXLVL)
+		return;
+	struct lvlstats *l = getlvl(arg, lvl);
+	if (ent->kind == 'u') {
+		struct plrent *p = uidtab_get(&arg->plrs, uid);
+		l->unlocks++;
+		p->lvl = lvl;
+		p->unlockts = ent->ts;
+	} else if (ent->kind == 'c') {
+		struct plrent *p = uidtab_find(&arg->plrs, uid);
+		l->solves++;
+		if (ent->ts && p && p->unlockts && p->lvl == lvl)
+			addsolvetime(l, ent->ts - p->unlockts);
+	} else {
+		l->wrong++;
+		arg->nwrong++;
+	}
+
+	if (!ent->ts)
+		return;
+	arg->ntimed++;
+	if (!arg->firstts || ent->ts < arg->firstts)
+		arg->firstts = ent->ts;
+	if (ent->ts > arg->lastts)
+		arg->lastts = ent->ts;
+	unsigned hour = (ent->ts / 1000 + arg->gmtoff) / 3600 % 24;
+	if (ent->kind == 'u') {
+		arg->hourunlocks[hour]++;
+		return;
+	}
+	arg->hourclaims[hour]++;
+	if (ent->kind == 'a')
+		arg->hourwrong[hour]++;
+	if (arg->nclaims == arg->claimscap) {
+		arg->claimscap = arg->claimscap ? arg->claimscap * 2 : 1024;
+		arg->claimts = MUST(realloc(arg->claimts, arg->claimscap * sizeof(*arg->claimts)));
+	}
+	arg->claimts[arg->nclaims++] = ent->ts;
+}
+
+static char *fmtdur(unsigned long long ms, char *buf, size_t size) {
+	unsigned long long s = ms / 1000;
+	if (s < 60 && ms % 1000 == 0)
+		snprintf(buf, size, "%llus", s);
+	else if (s < 60)
+		snprintf(buf, size, "%.1fs", ms / 1e3);
+	else if (s < 60 * 60)
+		snprintf(buf, size, "%llum%02llus", s / 60, s % 60);
+	else if (s < 60 * 60 * 24)
+		snprintf(buf, size, "%lluh%02llum", s / 3600, s / 60 % 60);
+	else
+		snprintf(buf, size, "%llud%02lluh", s / 86400, s / 3600 % 24);
+	return buf;
+}
+
+static char *fmttime(unsigned long long ms, char *fmt, char *buf, size_t size) {
+	time_t secs = ms / 1000;
+	struct tm tm;
+	strftime(buf, size, fmt, localtime_r(&secs, &tm));
+	return buf;
+}
+
+static void printbar(unsigned long n, unsigned long max) {
+	int len = max ? (n * BARWIDTH + max - 1) / max : 0;
+	if (len)
+		fputs("  ", stdout);
+	for (int i = 0; i < len; i++)
+		putchar('#');
+	putchar('\n');
+}
+
+static int cmpull(const void *a, const void *b) {
+	unsigned long long x = *(unsigned long long *)a, y = *(unsigned long long *)b;
+	return (x > y) - (x < y);
+}
+
+static void printlevels(struct _stats_iter_arg *arg) {
+	char p50[32], p90[32], max[32];
+	printf("level   unlocks    solves     wrong  tries/solve  p50 solve  p90 solve  max solve\n");
+	for (unsigned i = 0; i < arg->nlvls; i++) {
+		struct lvlstats *l = &arg->lvls[i];
+		printf("%5u %9lu %9lu %9lu", i + 1, l->unlocks, l->solves, l->wrong);
+		if (l->solves)
+			printf(" %12.2f", (double)(l->solves + l->wrong) / l->solves);
+		else
+			printf(" %12s", "-");
+		if (l->ntimes) {
+			qsort(l->times, l->ntimes, sizeof(*l->times), cmpull);
+			printf(" %10s %10s %10s\n",
+				fmtdur(l->times[l->ntimes / 2], p50, sizeof(p50)),
+				fmtdur(l->times[l->ntimes * 9 / 10], p90, sizeof(p90)),
+				fmtdur(l->times[l->ntimes - 1], max, sizeof(max)));
+		} else {
+			printf(" %10s %10s %10s\n", "-", "-", "-");
+		}
+	}
+}
+
+static void printhistograms(struct _stats_iter_arg *arg) {
+	for (unsigned i = 0; i < arg->nlvls; i++) {
+		struct lvlstats *l = &arg->lvls[i];
+		if (l->ntimes == 0)
+			continue;
+		int first = 0, last = NBUCKETS - 1;
+		unsigned long most = 0;
+		while (l->buckets[first] == 0)
+			first++;
+		while (l->buckets[last] == 0)
+			last--;
+		for (int b = first; b <= last; b++) {
+			if (l->buckets[b] > most)
+				most = l->buckets[b];
+		}
+		printf("\nsolve times for level %u (%zu solves):\n", i + 1, l->ntimes);
+		for (int b = first; b <= last; b++) {
+			char bound[32];
+			fmtdur((1ULL << b) * 1000, bound, sizeof(bound));
+			printf("  <%-9s %9lu", bound, l->buckets[b]);
+			printbar(l->buckets[b], most);
+		}
+	}
+}
+
+static void printarrivals(struct _stats_iter_arg *arg) {
+	unsigned long most = 0;
+	for (int h = 0; h < 24; h++) {
+		if (arg->hourclaims[h] > most)
+			most = arg->hourclaims[h];
+	}
+	printf("\narrivals by hour of the day:\n");
+	printf("hour   unlocks    claims     wrong\n");
+	for (int h = 0; h < 24; h++) {
+		printf("  %02d %9lu %9lu %9lu", h, arg->hourunlocks[h], arg->hourclaims[h],
+			arg->hourwrong[h]);
+		printbar(arg->hourclaims[h], most);
+	}
+
+	if (arg->nclaims == 0)
+		return;
+	qsort(arg->claimts, arg->nclaims, sizeof(*arg->claimts), cmpull);
+	for (size_t i = 0; i < arg->nclaims; i++) {
+		bumppeak(&arg->peakhour, arg->claimts[i] / 3600000);
+		bumppeak(&arg->peakminute, arg->claimts[i] / 60000);
+	}
+	char when[64];
+	double hours = (arg->lastts - arg->firstts) / 3600e3;
+	// an average over less than an hour says more about the span than the rate
+	if (hours >= 1)
+		printf("\nclaims: %zu, %.1f per hour on average\n", arg->nclaims, arg->nclaims / hours);
+	else
+		printf("\nclaims: %zu\n", arg->nclaims);
+	printf("busiest hour: %lu claims, from %s\n", arg->peakhour.max,
+		fmttime(arg->peakhour.at * 3600000, "%Y-%m-%d %H:%M", when, sizeof(when)));
+	printf("busiest minute: %lu claims, at %s\n", arg->peakminute.max,
+		fmttime(arg->peakminute.at * 60000, "%Y-%m-%d %H:%M", when, sizeof(when)));
+}
+
+void dbstats(char *dbpath, char *attemptspath) {
+	size_t len, attemptslen;
+	char *content = mapdb(dbpath, &len);
+	char *attempts = mapdb(attemptspath, &attemptslen);
+
+	struct _stats_iter_arg arg = {
+		.plrs = { .entsize = sizeof(struct plrent) },
+	};
+	// The offset as of now; good enough for a day's curve, though hours
+	// on the other side of a DST change are off by one.
+	time_t now = time(NULL);
+	struct tm tm;
+	arg.gmtoff = localtime_r(&now, &tm)->tm_gmtoff;
+	parsedb(content, len, _stats_iter, &arg);
+	parsedb(attempts, attemptslen, _stats_iter, &arg);
+
+	char first[64], last[64];
+	printf("%lu records (%lu of them wrong claims), %lu with timestamps",
+		arg.nrecords, arg.nwrong, arg.ntimed);
+	if (arg.ntimed) {
+		printf(", from %s to %s",
+			fmttime(arg.firstts, "%Y-%m-%d %H:%M", first, sizeof(first)),
+			fmttime(arg.lastts, "%Y-%m-%d %H:%M", last, sizeof(last)));
+	}
+	printf("\n\n");
+	printlevels(&arg);
+	printhistograms(&arg);
+	if (arg.ntimed)
+		printarrivals(&arg);
+
+	for (unsigned i = 0; i < arg.nlvls; i++)
+		free(arg.lvls[i].times);
+	free(arg.lvls);
+	free(arg.claimts);
+	uidtab_free(&arg.plrs);
+	unmapdb(content, len);
+	unmapdb(attempts, attemptslen);
+}
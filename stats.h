@@ -0,0 +1,11 @@
+#ifndef __HAVE_STATS_H
+#define __HAVE_STATS_H
+
+// Reads the db and the log of wrong claims in one pass each and prints,
+// for each level, how many tries and how long players take to solve it,
+// and when during the day unlocks and claims arrive. Like exportdb(), it
+// reads them without taking the lock. Only records with timestamps count
+// towards timings.
+void dbstats(char *dbpath, char *attemptspath);
+
+#endif
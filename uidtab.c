@@ -0,0 +1,75 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "uidtab.h"
+#include "util.h"
+
+static size_t uidhash(uid_t uid) {
+	// fibonacci hashing; uids tend to be sequential
+	return (size_t)((unsigned long long)uid * 0x9E3779B97F4A7C15ull >> 32);
+}
+
+static struct uidtabent *slot(void *tab, size_t entsize, size_t i) {
+	return (struct uidtabent *)((char *)tab + i * entsize);
+}
+
+static struct uidtabent *findslot(void *tab, size_t entsize, size_t cap, uid_t uid) {
+	size_t i = uidhash(uid) & (cap - 1);
+	while (slot(tab, entsize, i)->used && slot(tab, entsize, i)->uid != uid)
+		i = (i + 1) & (cap - 1);
+	return slot(tab, entsize, i);
+}
+
+static void resize(struct uidtab *t, size_t newcap) {
+	void *newtab = MUST(calloc(newcap, t->entsize));
+	for (size_t i = 0; i < t->cap; i++) {
+		struct uidtabent *ent = slot(t->tab, t->entsize, i);
+		if (ent->used)
+			memcpy(findslot(newtab, t->entsize, newcap, ent->uid), ent, t->entsize);
+	}
+	free(t->tab);
+	t->tab = newtab;
+	t->cap = newcap;
+}
+
+// grows t so that it holds n entries without growing again
+static void reserve(struct uidtab *t, size_t n) {
+	size_t newcap = t->cap ? t->cap : 64;
+	while (n * 2 > newcap)
+		newcap *= 2;
+	if (newcap != t->cap)
+		resize(t, newcap);
+}
+
+void *uidtab_find(struct uidtab *t, uid_t uid) {
+	if (t->cap == 0)
+		return NULL;
+	struct uidtabent *ent = findslot(t->tab, t->entsize, t->cap, uid);
+	return ent->used ? ent : NULL;
+}
+
+void *uidtab_add(struct uidtab *t, uid_t uid) {
+	reserve(t, t->count + 1);
+	struct uidtabent *ent = findslot(t->tab, t->entsize, t->cap, uid);
+	ent->used = 1;
+	ent->uid = uid;
+	t->count++;
+	return ent;
+}
+
+void *uidtab_get(struct uidtab *t, uid_t uid) {
+	void *ent = uidtab_find(t, uid);
+	return ent ? ent : uidtab_add(t, uid);
+}
+
+void *uidtab_at(struct uidtab *t, size_t i) {
+	struct uidtabent *ent = slot(t->tab, t->entsize, i);
+	return ent->used ? ent : NULL;
+}
+
+void uidtab_free(struct uidtab *t) {
+	free(t->tab);
+	t->tab = NULL;
+	t->cap = 0;
+	t->count = 0;
+}
@@ -0,0 +1,35 @@
+#ifndef __HAVE_UIDTAB_H
+#define __HAVE_UIDTAB_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Every entry of a uidtab starts with this, the rest is up to the user:
+//     struct plrent { struct uidtabent hdr; unsigned lvl; };
+struct uidtabent {
+	uid_t uid;
+	int used;
+};
+
+// Open-addressed hash table keyed by uid. The capacity is always a power
+// of 2 and the load factor is kept under 1/2. A zeroed uidtab with
+// entsize set is an empty table.
+struct uidtab {
+	void *tab;
+	size_t entsize;
+	size_t cap;
+	size_t count;
+};
+
+// the entry for uid, or NULL if there isn't one
+void *uidtab_find(struct uidtab *t, uid_t uid);
+// Adds a zeroed entry for uid, which mustn't be in t yet, and returns it.
+// Pointers to entries are only good until the next add.
+void *uidtab_add(struct uidtab *t, uid_t uid);
+// the entry for uid, added if there isn't one
+void *uidtab_get(struct uidtab *t, uid_t uid);
+// slot i (< cap) of t, or NULL if it's empty, for going through every entry
+void *uidtab_at(struct uidtab *t, size_t i);
+void uidtab_free(struct uidtab *t);
+
+#endif
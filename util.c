@@ -1,3 +1,4 @@
+#include <stdlib.h>
 #include <string.h>
 #include <sys/random.h>
 
@@ -7,10 +8,67 @@
 #define UCALPHA "QWERTYUIOPASDFGHJKLZXCVBNM"
 #define DIGITS "0123456789"
 
+// nonzero once rand_seed() has been called
+static int g_seeded;
+static unsigned long long g_seed;
+
+// splitmix64
+static unsigned long long nextseeded(void) {
+	unsigned long long z = (g_seed += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+static void fillpool(unsigned char *pool, size_t len) {
+	size_t got = 0;
+	while (got < len) {
+		ssize_t n = getrandom(pool + got, len - got, 0);
+		if (n == -1 && errno != EINTR) {
+			perror("getrandom");
+			exit(1);
+		}
+		if (n > 0)
+			got += n;
+	}
+}
+
+static void randbytes(void *buf, size_t len) {
+	// Generating a level asks for a few bytes at a time, thousands of
+	// times, so draw from a pool rather than making a syscall each time.
+	static unsigned char pool[4096];
+	static size_t poolleft;
+
+	unsigned char *p = buf;
+	if (g_seeded) {
+		for (size_t i = 0; i < len; i++)
+			p[i] = nextseeded();
+		return;
+	}
+	while (len > 0) {
+		if (poolleft == 0) {
+			fillpool(pool, sizeof(pool));
+			poolleft = sizeof(pool);
+		}
+		size_t n = len < poolleft ? len : poolleft;
+		memcpy(p, pool + sizeof(pool) - poolleft, n);
+		// don't leave used bytes lying around
+		memset(pool + sizeof(pool) - poolleft, 0, n);
+		poolleft -= n;
+		p += n;
+		len -= n;
+	}
+}
+
+void rand_seed(unsigned long long seed) {
+	g_seeded = 1;
+	g_seed = seed;
+}
+
 unsigned rand_lt(unsigned lt) {
-	char buf[sizeof(unsigned)];
-	getrandom(buf, sizeof(buf), 0);
-	return *((unsigned *)buf) % lt;
+	unsigned r;
+	randbytes(&r, sizeof(r));
+	return r % lt;
 }
 
 unsigned rand_between(unsigned min, unsigned lt) {
@@ -22,10 +80,12 @@ static char randchr(char *choices) {
 }
 
 static void randstr(char *legal, char *buf, size_t len) {
-	getrandom(buf, len - 1, 0);
+	unsigned char *ubuf = (unsigned char *)buf;
+	size_t nlegal = strlen(legal);
+	randbytes(buf, len - 1);
 	buf[len - 1] = '\0';
 	for (size_t i = 0; i < len - 1; i++)
-		buf[i] = legal[buf[i] % strlen(legal)];
+		buf[i] = legal[ubuf[i] % nlegal];
 }
 
 // random alphanumeric string
@@ -36,7 +96,8 @@ void randalnum(char *buf, size_t len) {
 
 void randalnum_guaranteed_alpha(char *buf, size_t len) {
 	randalnum(buf, len);
-	buf[rand_lt(len)] = randchr(LCALPHA UCALPHA);
+	// len - 1, so that we don't overwrite the NUL
+	buf[rand_lt(len - 1)] = randchr(LCALPHA UCALPHA);
 }
 
 void randdigits(char *buf, size_t len) {
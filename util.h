@@ -20,6 +20,10 @@
 	})
 
 
+// Makes all of the rand* functions below deterministic, for benchmarks
+// and tests. Without it they use getrandom().
+void rand_seed(unsigned long long seed);
+
 void randalnum(char *buf, size_t len);
 void randalnum_guaranteed_alpha(char *buf, size_t len);
 unsigned rand_lt(unsigned lt);